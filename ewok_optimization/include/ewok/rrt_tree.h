@@ -0,0 +1,179 @@
+/**
+* This file is part of Ewok.
+*
+* Copyright 2017 Vladyslav Usenko, Technical University of Munich.
+* Developed by Vladyslav Usenko <vlad dot usenko at tum dot de>,
+* for more information see <http://vision.in.tum.de/research/robotvision/replanning>.
+* If you use this code, please cite the respective publications as
+* listed on the above website.
+*
+* Ewok is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* Ewok is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with Ewok. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef EWOK_OPTIMIZATION_INCLUDE_EWOK_RRT_TREE_H_
+#define EWOK_OPTIMIZATION_INCLUDE_EWOK_RRT_TREE_H_
+
+#include <Eigen/Core>
+
+#include <cstdint>
+#include <vector>
+
+namespace ewok {
+
+// Tree of an RRT planner stored in arrays indexed by node. Children of a
+// node are linked through first child and next sibling, so adding a node
+// or moving it to another parent does not allocate. clear() keeps the
+// arrays, the next tree reuses them.
+template<typename _Scalar>
+class RRTTree {
+ public:
+
+  typedef Eigen::Matrix<_Scalar, 3, 1> Vector3;
+  typedef uint32_t Index;
+
+  // Parent of the root, end of a child list
+  static const Index NONE = 0xffffffff;
+
+  RRTTree() : size_(0) {}
+
+  // Removes all nodes, keeps the storage
+  inline void clear() {
+    size_ = 0;
+  }
+
+  void reserve(size_t num_nodes) {
+    positions_.reserve(num_nodes);
+    costs_.reserve(num_nodes);
+    parents_.reserve(num_nodes);
+    first_children_.reserve(num_nodes);
+    next_siblings_.reserve(num_nodes);
+  }
+
+  inline size_t size() const {
+    return size_;
+  }
+
+  inline bool empty() const {
+    return size_ == 0;
+  }
+
+  // Adds a node as the first child of parent, a root if parent is NONE
+  Index addNode(const Vector3 & pos, _Scalar cost, Index parent = NONE) {
+    const Index node = size_;
+
+    if (size_ == positions_.size()) {
+      positions_.push_back(pos);
+      costs_.push_back(cost);
+      parents_.push_back(NONE);
+      first_children_.push_back(NONE);
+      next_siblings_.push_back(NONE);
+    } else {
+      positions_[node] = pos;
+      costs_[node] = cost;
+      parents_[node] = NONE;
+      first_children_[node] = NONE;
+      next_siblings_[node] = NONE;
+    }
+
+    size_++;
+
+    if (parent != NONE) link(node, parent);
+
+    return node;
+  }
+
+  // Moves node with its subtree to parent. Costs are not changed, see
+  // addCostToDescendants.
+  void setParent(Index node, Index parent) {
+    if (parents_[node] != NONE) unlink(node);
+    if (parent != NONE) link(node, parent);
+  }
+
+  inline const Vector3 & position(Index node) const {
+    return positions_[node];
+  }
+
+  inline _Scalar cost(Index node) const {
+    return costs_[node];
+  }
+
+  inline void setCost(Index node, _Scalar cost) {
+    costs_[node] = cost;
+  }
+
+  // Adds delta to the costs of all nodes below node, not to node itself.
+  // Walks the subtree through the links, so needs no stack.
+  void addCostToDescendants(Index node, _Scalar delta) {
+    Index n = first_children_[node];
+
+    while (n != NONE) {
+      costs_[n] += delta;
+
+      if (first_children_[n] != NONE) {
+        n = first_children_[n];
+        continue;
+      }
+
+      while (next_siblings_[n] == NONE) {
+        n = parents_[n];
+        if (n == node) return;
+      }
+
+      n = next_siblings_[n];
+    }
+  }
+
+  inline Index parent(Index node) const {
+    return parents_[node];
+  }
+
+  inline Index firstChild(Index node) const {
+    return first_children_[node];
+  }
+
+  inline Index nextSibling(Index node) const {
+    return next_siblings_[node];
+  }
+
+ protected:
+
+  inline void link(Index node, Index parent) {
+    parents_[node] = parent;
+    next_siblings_[node] = first_children_[parent];
+    first_children_[parent] = node;
+  }
+
+  // Linear in the number of siblings
+  void unlink(Index node) {
+    Index * next = &first_children_[parents_[node]];
+    while (*next != node) next = &next_siblings_[*next];
+
+    *next = next_siblings_[node];
+    parents_[node] = NONE;
+    next_siblings_[node] = NONE;
+  }
+
+  size_t size_;
+
+  std::vector<Vector3> positions_;
+  std::vector<_Scalar> costs_;
+  std::vector<Index> parents_, first_children_, next_siblings_;
+};
+
+template<typename _Scalar>
+const typename RRTTree<_Scalar>::Index RRTTree<_Scalar>::NONE;
+
+}  // namespace ewok
+
+#endif  // EWOK_OPTIMIZATION_INCLUDE_EWOK_RRT_TREE_H_
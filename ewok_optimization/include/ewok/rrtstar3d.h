@@ -18,6 +18,9 @@
 
 #include <ewok/ed_ring_buffer.h>
 #include <ewok/polynomial_trajectory_3d.h>
+#include <ewok/rrt_tree.h>
+#include <ewok/spatial_hash_grid.h>
+#include <ewok/thread_pool.h>
 #include <ewok/uniform_bspline_3d.h>
 #include <ros/console.h>
 #include <ros/ros.h>
@@ -33,6 +36,7 @@
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <queue>
 #include <random>
 #include <vector>
@@ -54,39 +58,34 @@ public:
     typedef Eigen::Quaternion<_Scalar> Quaternion;
 
     typedef Eigen::Matrix<int, 3, 1> Vector3i;
-    typedef std::tuple<Vector3, Vector3, bool> Edge;
     typedef std::pair<Vector3, Vector3> PPoint;
     typedef std::pair<Vector3, bool> PointBool;
     typedef std::pair<Eigen::Vector3f, bool> PointBoolF;
 
     typedef std::shared_ptr<RRTStar3D<_N, _Scalar, _Datatype>> Ptr;
 
-    struct Node
-    {
-        std::vector<Node*> children_;
-        Node* parent_ = NULL;
-        Vector3 pos_;
-        _Scalar cost_;
-    };
+    typedef RRTTree<_Scalar> Tree;
+    typedef typename Tree::Index NodeIndex;
 
     RRTStar3D(_Scalar step_size = 0.5, _Scalar rrt_factor = 1.1, _Scalar radius = 1, _Scalar solve_tmax = 1,
-              _Scalar dt = 0.5, int NUM_ITER=1000)
+              _Scalar dt = 0.5, int NUM_ITER=1000, int num_threads = 1)
         : spline_(dt)
-        , step_size_(step_size)
-        , rrt_factor_(rrt_factor)
-        , radius_(radius)
-        , debugging_(false)
         , flat_height(true)
-        , sampling_alpha(0.2)
-        , sampling_beta(0.5)
-        , max_solve_t_(solve_tmax)
+        , debugging_(false)
+        , algorithm_(false)
         , dt_(dt)
+        , max_solve_t_(solve_tmax)
+        , rrt_factor_(rrt_factor)
+        , radius_(radius)
+        , step_size_(step_size)
         , flag_sol_found(false)
         , flag_rrt_running(false)
-        , algorithm_(false)
+        , rng{std::random_device{}()}
+        , sampling_alpha(0.2)
+        , sampling_beta(0.5)
         , flag_save_log_(false)
+        , cost_propagation_(true)
         , N_iter(NUM_ITER)
-        , rng{std::random_device{}()}
     {
 
         current_t = 0;
@@ -100,51 +99,35 @@ public:
         flag_rewire_root = false;
         flag_new_path_selected = false;
         rrt_counter=0;
+
+        setNumThreads(num_threads);
     }
 
     void reset()
     {
-        for (auto p : nodes_)
-        {
-            delete p;
-        }
-        nodes_.clear();
+        tree_.clear();
+        node_index_.clear(step_size_);
 
         x_sol_.clear();
 
         solution_queue.clear();
 
         path_point_.clear();
-        edges_.clear();
     }
 
     void initialize()
     {
-        for (auto p : nodes_)
-        {
-            delete p;
-        }
-        nodes_.clear();
+        tree_.clear();
+        node_index_.clear(step_size_);
 
-        for (auto p : x_sol_)
-        {
-            delete p;
-        }
         x_sol_.clear();
 
-        edges_.clear();
-
-        root_ = new Node;
-        root_->parent_ = NULL;
-        root_->pos_ = start_;
-        root_->cost_ = 0;
+        root_ = tree_.addNode(start_, 0);
         lastNode_ = root_;
-        nodes_.push_back(root_);
+        node_index_.insert(start_, root_);
 
-        sub_root = new Node;
         sub_root = root_;
-
-        goal_node = new Node;
+        solution_node = temp_solution = Tree::NONE;
     }
 
     void setLogPath(const std::string& path, bool save_log=false)
@@ -182,6 +165,36 @@ public:
         edrb_ = edrb;
     }
 
+    // With more than one thread the tree grows by batches of samples, see
+    // extendTreeBatch. Sets the batch size to 8 samples per thread.
+    void setNumThreads(int num_threads)
+    {
+        if (num_threads > 1)
+            thread_pool_.reset(new ThreadPool(num_threads));
+        else
+            thread_pool_.reset();
+
+        batch_size_ = 8 * getNumThreads();
+    }
+
+    int getNumThreads() const
+    {
+        return thread_pool_ ? thread_pool_->size() : 1;
+    }
+
+    void setBatchSize(int batch_size)
+    {
+        batch_size_ = batch_size;
+    }
+
+    // If enabled, which is the default, a rewire also updates the costs of
+    // the descendants of the rewired node. Disabling it is only meant for
+    // comparisons.
+    void setCostPropagation(bool enable)
+    {
+        cost_propagation_ = enable;
+    }
+
 
     void addControlPoint(const Vector3& point, int num = 1)
     {
@@ -246,7 +259,6 @@ public:
     {
         mutex.lock();
         target_ = target;
-        goal_node->pos_ = target;
         global_min_cost = distance(start_, target_);
 
         // informed rrt sampling
@@ -273,15 +285,14 @@ public:
         height_ = point;
     }
 
-    _Scalar getCost(const Node* n)
+    _Scalar getCost(NodeIndex n)
     {
-        _Scalar cost = n->cost_;
-        return cost;
+        return tree_.cost(n);
     }
 
-    _Scalar getDistCost(const Node* p, const Node* q)
+    _Scalar getDistCost(NodeIndex p, NodeIndex q)
     {
-        return distance(q->pos_, p->pos_);
+        return distance(tree_.position(q), tree_.position(p));
     }
 
     _Scalar getDistCost(const Vector3 p, const Vector3 q)
@@ -303,54 +314,28 @@ public:
         return false;
     }
 
-    bool isCollision(const Node* p, const Node* q)
+    bool isCollision(NodeIndex p, NodeIndex q)
     {
         if (!edrb_.get())
         {
             ROS_INFO_COND_NAMED(debugging_, "RRT PLANNER", "EDRB ERROR");
             return true;
         }
-        bool collision = false;
-
-        std::vector<Vector3> point_check;
-
-        Vector3 len = (q->pos_ - p->pos_);
-        point_check.push_back(p->pos_);
-        point_check.push_back(p->pos_ + 0.25 * len);
-        point_check.push_back(p->pos_ + 0.5 * len);
-        point_check.push_back(p->pos_ + 0.75 * len);
-        point_check.push_back(q->pos_);
-
-        for (Vector3 pt : point_check)
-        {
-            collision = edrb_->isNearObstacle(pt, radius_);
-            if (collision)
-                break;
-        }
-        return collision;
+        return isCollision(tree_.position(p), tree_.position(q));
     }
 
+    // Checks every voxel the edge passes through, see
+    // EuclideanDistanceRingBuffer::isSegmentNearObstacle
     bool isCollision(const Vector3 from, const Vector3 to)
     {
-        bool collision;
-        collision = false;
-
-        std::vector<Vector3> point_check;
-
-        Vector3 len = to-from;
-        point_check.push_back(from);
-        point_check.push_back(from + 0.25 * len);
-        point_check.push_back(from + 0.5 * len);
-        point_check.push_back(from + 0.75 * len);
-        point_check.push_back(to);
-        for (Vector3 pt : point_check)
-        {
-            collision = edrb_->isNearObstacle(pt, radius_);
-            if (collision)
-                break;
-        }
+        return edrb_->isSegmentNearObstacle(from, to, radius_);
+    }
 
-        return collision;
+    // Same as above while holding the lock from
+    // EuclideanDistanceRingBuffer::lockForQueries, takes no locks
+    bool isCollision(const Vector3 from, const Vector3 to, const std::vector<Vector3i>& stencil)
+    {
+        return edrb_->isSegmentNearObstacleUnlocked(from, to, radius_, stencil);
     }
 
     _Scalar getRandomNumber(const _Scalar a, const _Scalar b)
@@ -365,29 +350,33 @@ public:
     {
         _Scalar min_cost = std::numeric_limits<_Scalar>::infinity();
         _Scalar min_dist = 3*step_size_;
-        for (auto n : x_sol_)
+        for (NodeIndex n : x_sol_)
         {
-            if (n->cost_ <= min_cost && distance(n->pos_, target_) < min_dist)
+            if (tree_.cost(n) <= min_cost && distance(tree_.position(n), target_) < min_dist)
             {
-                min_cost = n->cost_;
-                min_dist = distance(n->pos_, target_);
+                min_cost = tree_.cost(n);
+                min_dist = distance(tree_.position(n), target_);
             }
         }
 
         return min_cost;
     }
 
-    Node* findSolutionNode()
+    // The node closest to the target if none reached it yet
+    NodeIndex findSolutionNode()
     {
-        Node* final = new Node;
+        if (x_sol_.empty())
+            return getNearestNode(target_);
+
+        NodeIndex final = Tree::NONE;
         _Scalar min_cost = std::numeric_limits<_Scalar>::infinity();
         _Scalar min_dist = std::numeric_limits<_Scalar>::infinity();
-        for (auto n : x_sol_)
+        for (NodeIndex n : x_sol_)
         {
-            if (n->cost_ <= min_cost && distance(n->pos_, target_) < min_dist)
+            if (tree_.cost(n) <= min_cost && distance(tree_.position(n), target_) < min_dist)
             {
-                min_cost = n->cost_;
-                min_dist = distance(n->pos_, target_);
+                min_cost = tree_.cost(n);
+                min_dist = distance(tree_.position(n), target_);
                 final = n;
             }
         }
@@ -409,11 +398,11 @@ public:
 
     Vector3 LineSampling()
     {
-        Node* near_n = getNearestNode(goal_node);
-        Vector3 len = goal_node->pos_ - near_n->pos_;
+        const Vector3& near_pos = tree_.position(getNearestNode(target_));
+        Vector3 len = target_ - near_pos;
         len = len / len.norm();
 
-        Vector3 point = near_n->pos_ + len * step_size_;
+        Vector3 point = near_pos + len * step_size_;
         if(flat_height) point.z() = height_.z();
         return point;
     }
@@ -480,7 +469,7 @@ public:
         return pos;
     }
 
-    Node* randomSampling(_Scalar& c_max)
+    Vector3 randomSampling(_Scalar& c_max)
     {
         Vector3 pos;
         if (isinf(c_max))
@@ -511,43 +500,23 @@ public:
             pos = EllipsoidSampling(c_max);
         }
 
-        Node* rand_node = new Node;
-        rand_node->pos_ = pos;
-        return rand_node;
+        return pos;
     }
 
-    Node* getNearestNode(const Node* node_)
+    NodeIndex getNearestNode(const Vector3& pos)
     {
-        _Scalar minDist = std::numeric_limits<_Scalar>::infinity();
-        Node* closest = new Node;
-
-        for (auto x_near: nodes_)
-        {
-            _Scalar dist = distance(node_->pos_, x_near->pos_);
-            if (dist < minDist)
-            {
-                minDist = dist;
-                closest = x_near;
-            }
-        }
-        return closest;
+        return node_index_.nearest(pos);
     }
 
-    void getNearestNodes(const Node* node, _Scalar radius, std::vector<Node*>& near)
+    void getNearestNodes(const Vector3& pos, _Scalar radius, std::vector<NodeIndex>& near)
     {
-        for (auto n : nodes_)
-        {
-            _Scalar dist = distance(node->pos_, n->pos_);
-            if (dist < radius)
-                near.push_back(n);
-        }
+        node_index_.radiusSearch(pos, radius, near);
     }
 
-    Vector3 getConfigurationNode(const Node* rand_, const Node* nearest_)
+    Vector3 getConfigurationNode(const Vector3& rand_pos, NodeIndex nearest_)
     {
         Vector3 pos;
-        Vector3 rand_pos = rand_->pos_;
-        Vector3 near_pos = nearest_->pos_;
+        const Vector3& near_pos = tree_.position(nearest_);
         Vector3 midPos = rand_pos - near_pos;
         if (midPos.norm() > step_size_)
         {
@@ -562,6 +531,190 @@ public:
         return pos;
     }
 
+    // Grows the tree by one sample, or by a batch of them when there is a
+    // thread pool, and adds the new nodes near the target to the solutions.
+    // Returns the number of samples.
+    int growTree(_Scalar& free_space, _Scalar& search_radius, bool& found)
+    {
+        if (!thread_pool_)
+        {
+            extendTree(free_space, search_radius);
+            addSolution(lastNode_, found);
+            return 1;
+        }
+
+        const NodeIndex first_new_node = tree_.size();
+        extendTreeBatch(free_space, search_radius);
+        for (NodeIndex n = first_new_node; n < tree_.size(); n++)
+            addSolution(n, found);
+
+        return batch_.size();
+    }
+
+    void extendTree(_Scalar& free_space, _Scalar& search_radius)
+    {
+        ROS_INFO_COND_NAMED(debugging_, "RRT PLANNER", "Getting Random Node");
+        mutex.lock();
+        if (x_sol_.size() > 0)
+            best_cost_ = getbestCost();
+        Vector3 rand_pos = randomSampling(best_cost_);
+        mutex.unlock();
+
+        ROS_INFO_COND_NAMED(debugging_, "RRT PLANNER", "Find Nearest");
+        mutex.lock();
+        NodeIndex nearest_node = getNearestNode(rand_pos);
+
+        ROS_INFO_COND_NAMED(debugging_, "RRT PLANNER", "Get Conf Node");
+        Vector3 new_pos = getConfigurationNode(rand_pos, nearest_node);
+        mutex.unlock();
+        if (!isCollision(tree_.position(nearest_node), new_pos))
+        {
+            near_nodes_.clear();
+            ROS_INFO_COND_NAMED(debugging_, "RRT PLANNER", "Get Nearest Nodes");
+
+            edrb_->getMapInfo(free_space);
+            rrt_gamma_ = 2*pow((1+1/3),1/3)*pow(free_space/4.189,1/3);
+            search_radius = std::min(rrt_gamma_*pow(log(tree_.size()+1)/tree_.size()+1, 1/3),
+                                     step_size_*rrt_factor_);
+            getNearestNodes(new_pos, search_radius, near_nodes_);
+
+            ROS_INFO_COND_NAMED(debugging_, "RRT PLANNER", "Find Parent");
+
+            NodeIndex min_node = nearest_node;
+            _Scalar min_cost = getCost(nearest_node) + getDistCost(tree_.position(nearest_node), new_pos);
+            for (NodeIndex x_near : near_nodes_)
+            {
+                _Scalar new_cost = getCost(x_near) + getDistCost(tree_.position(x_near), new_pos);
+                if (!isCollision(tree_.position(x_near), new_pos) && new_cost < min_cost)
+                {
+                    min_node = x_near;
+                    min_cost = new_cost;
+                }
+            }
+
+            NodeIndex new_node = tree_.addNode(new_pos, min_cost, min_node);
+            node_index_.insert(new_pos, new_node);
+            lastNode_ = new_node;
+
+            ROS_INFO_COND_NAMED(debugging_, "RRT PLANNER", "Rewire Tree");
+            for (NodeIndex x_near : near_nodes_)
+            {
+                _Scalar min_cost = getCost(new_node) + getDistCost(new_node, x_near);
+                bool isCollisionn = !isCollision(new_node, x_near);
+                if (isCollisionn && (min_cost < tree_.cost(x_near)))
+                {
+                    if (cost_propagation_)
+                        tree_.addCostToDescendants(x_near, min_cost - tree_.cost(x_near));
+                    tree_.setCost(x_near, min_cost);
+                    tree_.setParent(x_near, new_node);
+                }
+            }
+        }
+    }
+
+    // Batch RRT*: draws batch_size_ samples, then finds their nearest nodes,
+    // steers and checks all their edges on the thread pool. Adding the nodes
+    // and rewiring is serial, in the order of the samples, with the costs at
+    // that time. Nodes added in a batch are not seen by the other samples of
+    // the batch. Every edge is checked once, for choosing the parent and for
+    // rewiring. The map is locked and its distances refreshed once for the
+    // checks of the batch, so the threads check edges without locking.
+    void extendTreeBatch(_Scalar& free_space, _Scalar& search_radius)
+    {
+        batch_.resize(batch_size_);
+
+        ROS_INFO_COND_NAMED(debugging_, "RRT PLANNER", "Getting Random Nodes");
+        mutex.lock();
+        if (x_sol_.size() > 0)
+            best_cost_ = getbestCost();
+        for (Sample& s : batch_)
+            s.rand_pos = randomSampling(best_cost_);
+        mutex.unlock();
+
+        edrb_->getMapInfo(free_space);
+        rrt_gamma_ = 2*pow((1+1/3),1/3)*pow(free_space/4.189,1/3);
+        search_radius = std::min(rrt_gamma_*pow(log(tree_.size()+1)/tree_.size()+1, 1/3),
+                                 step_size_*rrt_factor_);
+
+        ROS_INFO_COND_NAMED(debugging_, "RRT PLANNER", "Check Samples");
+        std::unique_lock<std::mutex> map_lock = edrb_->lockForQueries();
+        const std::vector<Vector3i>& stencil = edrb_->getObstacleStencil(radius_);
+
+        thread_pool_->parallelFor(0, batch_.size(), [&](int, int begin, int end) {
+            for (int i = begin; i < end; i++)
+            {
+                Sample& s = batch_[i];
+                s.near.clear();
+                s.near_free.clear();
+
+                s.nearest = getNearestNode(s.rand_pos);
+                s.new_pos = getConfigurationNode(s.rand_pos, s.nearest);
+                s.free = !isCollision(tree_.position(s.nearest), s.new_pos, stencil);
+                if (!s.free) continue;
+
+                getNearestNodes(s.new_pos, search_radius, s.near);
+                s.near_free.resize(s.near.size());
+                for (size_t k = 0; k < s.near.size(); k++)
+                    s.near_free[k] = !isCollision(tree_.position(s.near[k]), s.new_pos, stencil);
+            }
+        });
+
+        map_lock.unlock();
+
+        ROS_INFO_COND_NAMED(debugging_, "RRT PLANNER", "Add Samples");
+        for (const Sample& s : batch_)
+        {
+            if (!s.free) continue;
+
+            NodeIndex min_node = s.nearest;
+            _Scalar min_cost = getCost(s.nearest) + getDistCost(tree_.position(s.nearest), s.new_pos);
+            for (size_t k = 0; k < s.near.size(); k++)
+            {
+                _Scalar new_cost = getCost(s.near[k]) + getDistCost(tree_.position(s.near[k]), s.new_pos);
+                if (s.near_free[k] && new_cost < min_cost)
+                {
+                    min_node = s.near[k];
+                    min_cost = new_cost;
+                }
+            }
+
+            NodeIndex new_node = tree_.addNode(s.new_pos, min_cost, min_node);
+            node_index_.insert(s.new_pos, new_node);
+            lastNode_ = new_node;
+
+            for (size_t k = 0; k < s.near.size(); k++)
+            {
+                NodeIndex x_near = s.near[k];
+                _Scalar min_cost = getCost(new_node) + getDistCost(new_node, x_near);
+                if (s.near_free[k] && (min_cost < tree_.cost(x_near)))
+                {
+                    if (cost_propagation_)
+                        tree_.addCostToDescendants(x_near, min_cost - tree_.cost(x_near));
+                    tree_.setCost(x_near, min_cost);
+                    tree_.setParent(x_near, new_node);
+                }
+            }
+        }
+    }
+
+    void addSolution(NodeIndex node, bool& found)
+    {
+        if (isNear(tree_.position(node), 0.75))
+        {
+            ROS_WARN_COND(algorithm_, "Found Solution");
+            if (std::find(x_sol_.begin(), x_sol_.end(), node) == x_sol_.end())
+            {
+                x_sol_.push_back(node);
+            }
+            found = true;
+            flag_sol_found = true;
+            if(temp_solution != Tree::NONE && x_sol_.size() > 0)
+            {
+                x_sol_.erase(std::remove(x_sol_.begin(), x_sol_.end(), temp_solution), x_sol_.end());
+            }
+        }
+    }
+
     bool solutionFound()
     {
         return flag_sol_found;
@@ -589,16 +742,16 @@ public:
 
                     ROS_WARN_STREAM_COND_NAMED(algorithm_, "Proces RRT 2", "Add Root to Path");
                     ROS_WARN_COND(algorithm_, "Add root to path");
-                    if (std::find(traj_points.begin(), traj_points.end(), sub_root->pos_) == traj_points.end())
+                    if (std::find(traj_points.begin(), traj_points.end(), tree_.position(sub_root)) == traj_points.end())
                     {
                         Vector3 last_point = traj_points[traj_points.size()-1];
 
-                        Vector3 mid_point = (last_point + sub_root->pos_)/2;
+                        Vector3 mid_point = (last_point + tree_.position(sub_root))/2;
 
                         traj_points.push_back(mid_point);
                         spline_.push_back(mid_point);
-                        traj_points.push_back(sub_root->pos_);
-                        spline_.push_back(sub_root->pos_);
+                        traj_points.push_back(tree_.position(sub_root));
+                        spline_.push_back(tree_.position(sub_root));
                     }
                     flag_rewire_root = true;
                 }
@@ -607,10 +760,10 @@ public:
                     flag_new_path_selected = false;
                     Vector3 last_point = traj_points[traj_points.size()-1];
 
-                    Vector3 mid_point = (last_point + sub_root->pos_)/2;
+                    Vector3 mid_point = (last_point + tree_.position(sub_root))/2;
 
-                    traj_points.push_back(mid_point); traj_points.push_back(sub_root->pos_);
-                    spline_.push_back(mid_point); spline_.push_back(sub_root->pos_);
+                    traj_points.push_back(mid_point); traj_points.push_back(tree_.position(sub_root));
+                    spline_.push_back(mid_point); spline_.push_back(tree_.position(sub_root));
                 }
             }
 
@@ -933,8 +1086,8 @@ public:
         flag_rrt_running = true;
         flag_rrt_started = true;
         flag_rrt_finished = false;
-        Node* final = NULL;
-        solution_node = new Node;
+        NodeIndex final = Tree::NONE;
+        solution_node = Tree::NONE;
         _Scalar search_radius;
         bool found = false;
         flag_sol_found = false;
@@ -952,114 +1105,30 @@ public:
         int iter_counter = 0;
         while(iter_counter < N_iter)
         {
-            ROS_INFO_COND_NAMED(debugging_, "RRT PLANNER", "Getting Random Node");
-            mutex.lock();
-            if (x_sol_.size() > 0)
-                best_cost_ = getbestCost();
-            Node* rand_node = randomSampling(best_cost_);
-            mutex.unlock();
-
-            if (rand_node)
-            {
-                ROS_INFO_COND_NAMED(debugging_, "RRT PLANNER", "Find Nearest");
-                mutex.lock();
-                Node* nearest_node = getNearestNode(rand_node);
-
-                ROS_INFO_COND_NAMED(debugging_, "RRT PLANNER", "Get Conf Node");
-                Node* new_node = new Node;
-                new_node->pos_ = getConfigurationNode(rand_node, nearest_node);
-                mutex.unlock();
-                if (!isCollision(nearest_node, new_node))
-                {
-                    std::vector<Node*> near_nodes;
-                    ROS_INFO_COND_NAMED(debugging_, "RRT PLANNER", "Get Nearest Nodes");
-
-                    edrb_->getMapInfo(free_space);
-                    rrt_gamma_ = 2*pow((1+1/3),1/3)*pow(free_space/4.189,1/3);
-                    search_radius = std::min(rrt_gamma_*pow(log(nodes_.size()+1)/nodes_.size()+1, 1/3),
-                                             step_size_*rrt_factor_);
-                    getNearestNodes(new_node, search_radius, near_nodes);
-
-                    ROS_INFO_COND_NAMED(debugging_, "RRT PLANNER", "Find Parent");
-
-                    Node* min_node = nearest_node;
-                    _Scalar min_cost = getCost(nearest_node) + getDistCost(nearest_node, new_node);
-                    for (auto x_near : near_nodes)
-                    {
-                        _Scalar new_cost = getCost(x_near) + getDistCost(x_near, new_node);
-                        if (!isCollision(x_near, new_node) && new_cost < min_cost)
-                        {
-                            min_node = x_near;
-                            min_cost = new_cost;
-                        }
-                    }
-
-                    new_node->parent_ = min_node;
-                    new_node->cost_ = min_cost;
-                    min_node->children_.push_back(new_node);
-                    edges_.push_back(std::make_tuple(min_node->pos_, new_node->pos_, false));
-                    nodes_.push_back(new_node);
-                    lastNode_ = new_node;
-
-                    ROS_INFO_COND_NAMED(debugging_, "RRT PLANNER", "Rewire Tree");
-                    for (Node* x_near : near_nodes)
-                    {
-                        _Scalar min_cost = getCost(new_node) + getDistCost(new_node, x_near);
-                        bool isCollisionn = !isCollision(new_node->pos_, x_near->pos_);
-                        if (isCollisionn && (min_cost < x_near->cost_ ))
-                        {
-                            Node* n_parent = new Node;
-                            n_parent = x_near->parent_;
-                            n_parent->children_.erase(std::remove(n_parent->children_.begin(), n_parent->children_.end(), x_near),
-                                                      n_parent->children_.end());
-                            edges_.erase(std::remove(edges_.begin(), edges_.end(), std::make_tuple(n_parent->pos_, x_near->pos_, false)),
-                                         edges_.end());
-                            x_near->cost_ = min_cost;
-                            x_near->parent_ = new_node;
-                            new_node->children_.push_back(x_near);
-                            edges_.push_back(std::make_tuple(new_node->pos_, x_near->pos_, false));
-                        }
-                    }
-                }
-            }
-
-            if (isNear(lastNode_->pos_, 0.75))
-            {
-                ROS_WARN_COND(algorithm_, "Found Solution");
-                if (std::find(x_sol_.begin(), x_sol_.end(), lastNode_) == x_sol_.end())
-                {
-                    x_sol_.push_back(lastNode_);
-                }
-                found = true;
-                flag_sol_found = true;
-                if(temp_solution && x_sol_.size() > 0)
-                {
-                    x_sol_.erase(std::remove(x_sol_.begin(), x_sol_.end(), temp_solution), x_sol_.end());
-                }
-            }
+            int num_samples = growTree(free_space, search_radius, found);
 
             std::chrono::duration<_Scalar> t_elapsed = std::chrono::high_resolution_clock::now() - search_t_stamp;
 
             _Scalar time_elapsed = t_elapsed.count();
-            if(x_sol_.size() > 1 || iter_counter > N_iter - 5)
+            if(x_sol_.size() > 1 || iter_counter + num_samples - 1 > N_iter - 5)
             {
                 if(found)
                 {
-                    std::vector<Node*> temp_solution;
-                    Node* possible_solution = findSolutionNode();
+                    std::vector<NodeIndex> temp_solution;
+                    NodeIndex possible_solution = findSolutionNode();
 
                     // if empty, add new solution to path
                     if(solution_queue.empty())
                     {
-                        curr_cost = possible_solution->cost_;
+                        curr_cost = tree_.cost(possible_solution);
                         final = possible_solution;
 
                         path_point_.clear();
-                        while (final != NULL)
+                        while (final != Tree::NONE)
                         {
-                            Vector3 pos = final->pos_;
+                            Vector3 pos = tree_.position(final);
                             path_point_.push_front(pos);
-                            final = final->parent_;
+                            final = tree_.parent(final);
                         }
                         path_point_.push_back(target_);
 
@@ -1067,11 +1136,11 @@ public:
                     else
                     {
                         final = possible_solution;
-                        while (final != NULL)
+                        while (final != Tree::NONE)
                         {
-                            Vector3 pos = final->pos_;
+                            Vector3 pos = tree_.position(final);
                             path_point_.push_front(pos);
-                            final = final->parent_;
+                            final = tree_.parent(final);
                         }
                         path_point_.push_back(target_);
 
@@ -1079,13 +1148,13 @@ public:
                 }
 
                 else {
-                    Node* possible_solution = getNearestNode(goal_node);
+                    NodeIndex possible_solution = getNearestNode(target_);
                     final = possible_solution;
-                    while (final != NULL)
+                    while (final != Tree::NONE)
                     {
-                        Vector3 pos = final->pos_;
+                        Vector3 pos = tree_.position(final);
                         path_point_.push_front(pos);
-                        final = final->parent_;
+                        final = tree_.parent(final);
                     }
                     path_point_.push_back(target_);
                     found = true;
@@ -1113,14 +1182,14 @@ public:
                          <<flag_real_target<<","
                         <<free_space<<","
                        <<search_radius<<","
-                      <<nodes_.size()<<","
+                      <<tree_.size()<<","
                      <<best_cost_<<","
                     <<curr_cost << "\n";
 
                 }
             }
 
-            iter_counter++;
+            iter_counter += num_samples;
         }
 
         std::cout << "Done" << std::endl;
@@ -1143,11 +1212,13 @@ public:
 
             if(rrt_tree_writer.is_open())
             {
-                for (int i = 0; i < edges_.size(); i++)
+                // An edge from the parent to every node but the root
+                for (NodeIndex n = 0; n < tree_.size(); n++)
                 {
-                    Vector3 p, q;
-                    p = std::get<0>(edges_[i]);
-                    q = std::get<1>(edges_[i]);
+                    if (tree_.parent(n) == Tree::NONE) continue;
+
+                    const Vector3& p = tree_.position(tree_.parent(n));
+                    const Vector3& q = tree_.position(n);
                     rrt_tree_writer<<std::fixed<<std::setprecision(8)<<p.transpose()<<","<<q.transpose()<<"\n";
                 }
             }
@@ -1172,8 +1243,8 @@ public:
         flag_rrt_running = true;
         flag_rrt_started = true;
         flag_rrt_finished = false;
-        Node* final = NULL;
-        solution_node = new Node;
+        NodeIndex final = Tree::NONE;
+        solution_node = Tree::NONE;
         loop_counter = 0;
         _Scalar search_radius;
         bool found = false;
@@ -1189,8 +1260,8 @@ public:
 
         ROS_INFO_COND_NAMED(algorithm_, "RRT PLANNER", "Starting RRT");
         best_cost_ = std::numeric_limits<_Scalar>::infinity();
-        while (Vector3(sub_root->pos_ - goal_node->pos_).norm() > 0.5 ||
-               ( Vector3(robot_pose_.translation() - goal_node->pos_).norm() > 0.5))
+        while (Vector3(tree_.position(sub_root) - target_).norm() > 0.5 ||
+               ( Vector3(robot_pose_.translation() - target_).norm() > 0.5))
         {
             curr_cost = -1;
 
@@ -1202,8 +1273,8 @@ public:
                 if(sol_pos > solution_queue.size()-3) break;
             }
 
-            if((Vector3(robot_pos-target_).norm() < 0.5 || (Vector3(sub_root->pos_ - goal_node->pos_).norm() < 0.5)) &&
-                 !isCollision(sub_root, goal_node)) break;
+            if((Vector3(robot_pos-target_).norm() < 0.5 || (Vector3(tree_.position(sub_root) - target_).norm() < 0.5)) &&
+                 !isCollision(tree_.position(sub_root), target_)) break;
 
 
             // Too Short
@@ -1224,7 +1295,7 @@ public:
 
                     if(solution_queue[i]==sub_root)
                     {
-                        if(Vector3(robot_pose_.translation() - sub_root->pos_).norm() < 2*step_size_)
+                        if(Vector3(robot_pose_.translation() - tree_.position(sub_root)).norm() < 2*step_size_)
                         {
                             sub_root = solution_queue[i+1];
                             replaced = true;
@@ -1237,13 +1308,13 @@ public:
                 if(!replaced && solution_queue.size() > 0)
                 {
                     _Scalar min_dist = std::numeric_limits<_Scalar>::infinity();
-                    Node* nearest_node = new Node;
+                    NodeIndex nearest_node = Tree::NONE;
                     for(auto node: solution_queue)
                     {
-                        if(distance(sub_root->pos_, node->pos_) < min_dist)
+                        if(distance(tree_.position(sub_root), tree_.position(node)) < min_dist)
                         {
                             nearest_node = node;
-                            min_dist = distance(sub_root->pos_, node->pos_);
+                            min_dist = distance(tree_.position(sub_root), tree_.position(node));
                         }
                     }
                     flag_new_path_selected = true;
@@ -1255,91 +1326,7 @@ public:
             }
 
 
-            ROS_INFO_COND_NAMED(debugging_, "RRT PLANNER", "Getting Random Node");
-            mutex.lock();
-            if (x_sol_.size() > 0)
-                best_cost_ = getbestCost();
-            Node* rand_node = randomSampling(best_cost_);
-            mutex.unlock();
-
-            if (rand_node)
-            {
-                ROS_INFO_COND_NAMED(debugging_, "RRT PLANNER", "Find Nearest");
-                mutex.lock();
-                Node* nearest_node = getNearestNode(rand_node);
-
-                ROS_INFO_COND_NAMED(debugging_, "RRT PLANNER", "Get Conf Node");
-                Node* new_node = new Node;
-                new_node->pos_ = getConfigurationNode(rand_node, nearest_node);
-                mutex.unlock();
-                if (!isCollision(nearest_node, new_node))
-                {
-                    std::vector<Node*> near_nodes;
-                    ROS_INFO_COND_NAMED(debugging_, "RRT PLANNER", "Get Nearest Nodes");
-
-                    edrb_->getMapInfo(free_space);
-                    rrt_gamma_ = 2*pow((1+1/3),1/3)*pow(free_space/4.189,1/3);
-                    search_radius = std::min(rrt_gamma_*pow(log(nodes_.size()+1)/nodes_.size()+1, 1/3),
-                                             step_size_*rrt_factor_);
-                    getNearestNodes(new_node, search_radius, near_nodes);
-
-                    ROS_INFO_COND_NAMED(debugging_, "RRT PLANNER", "Find Parent");
-
-                    Node* min_node = nearest_node;
-                    _Scalar min_cost = getCost(nearest_node) + getDistCost(nearest_node, new_node);
-                    for (auto x_near : near_nodes)
-                    {
-                        _Scalar new_cost = getCost(x_near) + getDistCost(x_near, new_node);
-                        if (!isCollision(x_near, new_node) && new_cost < min_cost)
-                        {
-                            min_node = x_near;
-                            min_cost = new_cost;
-                        }
-                    }
-
-                    new_node->parent_ = min_node;
-                    new_node->cost_ = min_cost;
-                    min_node->children_.push_back(new_node);
-                    edges_.push_back(std::make_tuple(min_node->pos_, new_node->pos_, false));
-                    nodes_.push_back(new_node);
-                    lastNode_ = new_node;
-
-                    ROS_INFO_COND_NAMED(debugging_, "RRT PLANNER", "Rewire Tree");
-                    for (Node* x_near : near_nodes)
-                    {
-                        _Scalar min_cost = getCost(new_node) + getDistCost(new_node, x_near);
-                        bool isCollisionn = !isCollision(new_node->pos_, x_near->pos_);
-                        if (isCollisionn && (min_cost < x_near->cost_ ))
-                        {
-                            Node* n_parent = x_near->parent_;
-                            n_parent->children_.erase(std::remove(n_parent->children_.begin(), n_parent->children_.end(), x_near),
-                                                      n_parent->children_.end());
-                            edges_.erase(std::remove(edges_.begin(), edges_.end(), std::make_tuple(n_parent->pos_, x_near->pos_, false)),
-                                         edges_.end());
-
-                            x_near->cost_ = min_cost;
-                            x_near->parent_ = new_node;
-                            new_node->children_.push_back(x_near);
-                            edges_.push_back(std::make_tuple(new_node->pos_, x_near->pos_, false));
-                        }
-                    }
-                }
-            }
-
-            if (isNear(lastNode_->pos_, 0.75))
-            {
-                ROS_WARN_COND(algorithm_, "Found Solution");
-                if (std::find(x_sol_.begin(), x_sol_.end(), lastNode_) == x_sol_.end())
-                {
-                    x_sol_.push_back(lastNode_);
-                }
-                found = true;
-                flag_sol_found = true;
-                if(temp_solution && x_sol_.size() > 0)
-                {
-                    x_sol_.erase(std::remove(x_sol_.begin(), x_sol_.end(), temp_solution), x_sol_.end());
-                }
-            }
+            int num_samples = growTree(free_space, search_radius, found);
 
             //generate solution in time
             std::chrono::duration<_Scalar> t_elapsed = std::chrono::high_resolution_clock::now() - search_t_stamp;
@@ -1347,24 +1334,23 @@ public:
             {
                 if(found)
                 {
-                    std::vector<Node*> temp_solution;
-                    Node* possible_solution = new Node;
-                    possible_solution= findSolutionNode();
+                    std::vector<NodeIndex> temp_solution;
+                    NodeIndex possible_solution = findSolutionNode();
 
                     // if empty, add new solution to path
                     if(solution_queue.size() == 0)
                     {
                         solution_node = possible_solution;
-                        curr_cost = possible_solution->cost_;
+                        curr_cost = tree_.cost(possible_solution);
                         final = possible_solution;
 
                         path_point_.clear();
-                        while (final != NULL)
+                        while (final != Tree::NONE)
                         {
-                            Vector3 pos = final->pos_;
+                            Vector3 pos = tree_.position(final);
                             path_point_.push_front(pos);
                             solution_queue.insert(solution_queue.begin(), final);
-                            final = final->parent_;
+                            final = tree_.parent(final);
                         }
                         path_point_.push_back(target_);
 
@@ -1375,10 +1361,10 @@ public:
                         final = possible_solution;
 
                         // check and combine path with original solution
-                        while (final != NULL)
+                        while (final != Tree::NONE)
                         {
                             temp_solution.insert(temp_solution.begin(), final);
-                            final = final->parent_;
+                            final = tree_.parent(final);
                         }
 
                         auto it_sol=find(solution_queue.begin(),solution_queue.end(),sub_root);
@@ -1395,28 +1381,28 @@ public:
                                 solution_queue.erase(solution_queue.begin(), solution_queue.end());
                                 solution_queue.clear();
                                 solution_queue = temp_solution;
-                                curr_cost = possible_solution->cost_;
+                                curr_cost = tree_.cost(possible_solution);
                                 final = possible_solution;
-                                while (final != NULL)
+                                while (final != Tree::NONE)
                                 {
-                                    Vector3 pos = final->pos_;
+                                    Vector3 pos = tree_.position(final);
                                     path_point_.push_front(pos);
-                                    final = final->parent_;
+                                    final = tree_.parent(final);
                                 }
                                 path_point_.push_back(target_);
                             }
 
                             // if there's no match or new path with smaller cost
                             // Need to rewrte the new solution method
-                            else if(it_temp == temp_solution.end() && possible_solution->cost_ < solution_node->cost_)
+                            else if(it_temp == temp_solution.end() && tree_.cost(possible_solution) < tree_.cost(solution_node))
                             {
                                 bool close_path = false;
-                                Node* close_node = new Node;
+                                NodeIndex close_node = Tree::NONE;
                                 for(auto p: temp_solution)
                                 {
-                                    if(distance(p->pos_, sub_root->pos_) < step_size_*2.5)
+                                    if(distance(tree_.position(p), tree_.position(sub_root)) < step_size_*2.5)
                                     {
-                                        if(!isCollision(p->pos_, sub_root->pos_))
+                                        if(!isCollision(tree_.position(p), tree_.position(sub_root)))
                                         {
                                             close_node = p;
                                             close_path = true;
@@ -1431,12 +1417,12 @@ public:
                                     solution_queue.clear();
                                     solution_queue = temp_solution;
                                     final = possible_solution;
-                                    curr_cost = possible_solution->cost_;
-                                    while (final != NULL)
+                                    curr_cost = tree_.cost(possible_solution);
+                                    while (final != Tree::NONE)
                                     {
-                                        Vector3 pos = final->pos_;
+                                        Vector3 pos = tree_.position(final);
                                         path_point_.push_front(pos);
-                                        final = final->parent_;
+                                        final = tree_.parent(final);
                                     }
                                     path_point_.push_back(target_);
                                 }
@@ -1449,7 +1435,7 @@ public:
                         {
                             for(int i = 0; i < solution_queue.size();i++)
                             {
-                                path_point_.push_back(solution_queue[i]->pos_);
+                                path_point_.push_back(tree_.position(solution_queue[i]));
                             }
 
                             path_point_.push_back(target_);
@@ -1460,9 +1446,8 @@ public:
                 }
 
                 else {
-                    temp_solution = new Node;
                     temp_solution = findSolutionNode();
-                    curr_cost = temp_solution->cost_;
+                    curr_cost = tree_.cost(temp_solution);
 
                     if (std::find(x_sol_.begin(), x_sol_.end(), temp_solution) == x_sol_.end())
                     {
@@ -1494,7 +1479,7 @@ public:
                          <<flag_real_target<<","
                         <<free_space<<","
                        <<search_radius<<","
-                      <<nodes_.size()<<","
+                      <<tree_.size()<<","
                      <<best_cost_<<","
                     <<curr_cost << "\n";
 
@@ -1504,7 +1489,7 @@ public:
             }
             mutex.unlock();
 
-            loop_counter++;
+            loop_counter += num_samples;
 
         }
         std::cout << "RRT FINISHED" << std::endl;
@@ -1586,7 +1571,7 @@ public:
     void getTreeMarker(visualization_msgs::Marker& traj_marker, const std::string& ns, int id = 0,
                        const Eigen::Vector3f& color = Eigen::Vector3f(1, 1, 0), _Scalar scale = 0.01)
     {
-        if (edges_.size() > 0)
+        if (tree_.size() > 1)
         {
             traj_marker.header.frame_id = "world";
             traj_marker.ns = ns;
@@ -1609,11 +1594,13 @@ public:
 
             traj_marker.color = c_free;
 
-            for (int i = 0; i < edges_.size() - 1; i++)
+            // An edge from the parent to every node but the root
+            for (NodeIndex n = 0; n < tree_.size(); n++)
             {
-                Vector3 p, q;
-                p = std::get<0>(edges_[i]);
-                q = std::get<1>(edges_[i]);
+                if (tree_.parent(n) == Tree::NONE) continue;
+
+                const Vector3& p = tree_.position(tree_.parent(n));
+                const Vector3& q = tree_.position(n);
 
                 geometry_msgs::Point p_, q_;
                 p_.x = p.x();
@@ -1623,16 +1610,8 @@ public:
                 q_.y = q.y();
                 q_.z = q.z();
 
-                if (std::get<2>(edges_[i]))
-                {
-                    traj_marker.points.push_back(p_);
-                    traj_marker.points.push_back(q_);
-                }
-                else
-                {
-                    traj_marker.points.push_back(p_);
-                    traj_marker.points.push_back(q_);
-                }
+                traj_marker.points.push_back(p_);
+                traj_marker.points.push_back(q_);
             }
         }
     }
@@ -1740,9 +1719,9 @@ public:
             traj_marker.points.push_back(point);
             traj_marker.colors.push_back(root_c);
 
-            point.x = sub_root->pos_.x();
-            point.y = sub_root->pos_.y();
-            point.z = sub_root->pos_.z();
+            point.x = tree_.position(sub_root).x();
+            point.y = tree_.position(sub_root).y();
+            point.z = tree_.position(sub_root).z();
             traj_marker.points.push_back(point);
             traj_marker.colors.push_back(subroot_c);
 
@@ -1753,6 +1732,8 @@ public:
 
     }
 
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
 protected:
     typename EuclideanDistanceRingBuffer<_N, _Datatype, _Scalar>::Ptr edrb_;
     typename PolynomialTrajectory3D<10, _Scalar>::Ptr trajectory_;
@@ -1788,21 +1769,41 @@ protected:
     _Scalar max_solve_t_;
 
     // RRT
-    std::list<Node*> nodes_, x_sol_;
-    Node *root_, *lastNode_, *goal_node;
+    Tree tree_;
+    std::vector<NodeIndex> x_sol_;
+
+    // tree_ nodes by position, cells of step_size_
+    SpatialHashGrid<_Scalar, NodeIndex> node_index_;
+    std::vector<NodeIndex> near_nodes_;
+    NodeIndex root_, lastNode_;
     _Scalar rrt_factor_, radius_;
     std::list<Vector3> path_point_;
-    std::vector<Edge> edges_;
     _Scalar step_size_;
     _Scalar rrt_gamma_;
 
     bool flag_sol_found, flag_rrt_running, flag_rewire_root;
     bool flag_new_path_selected;
-    Node* solution_node, *temp_solution, *sub_root;
-    std::vector<Node*> solution_queue;
+    NodeIndex solution_node, temp_solution, sub_root;
+    std::vector<NodeIndex> solution_queue;
     Vector3 last_point;
     std::mt19937 rng;
 
+    // Batch RRT*
+    struct Sample
+    {
+        Vector3 rand_pos, new_pos;
+        NodeIndex nearest;
+        bool free;
+
+        // Nodes within the search radius, if their edge is free
+        std::vector<NodeIndex> near;
+        std::vector<char> near_free;
+    };
+
+    std::unique_ptr<ThreadPool> thread_pool_;
+    std::vector<Sample> batch_;
+    int batch_size_;
+
     // Ellipsoid Sampling
     _Scalar sampling_alpha, sampling_beta;
     _Scalar global_min_cost, best_cost_;
@@ -1815,6 +1816,7 @@ protected:
     std::fstream rrt_writer, ellipsoid_writer;
     std::fstream rrt_path_writer, rrt_tree_writer;
     bool flag_save_log_;
+    bool cost_propagation_;
     int N_iter;
     int rrt_counter;
     int loop_counter;
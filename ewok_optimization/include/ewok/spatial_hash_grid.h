@@ -0,0 +1,228 @@
+/**
+* This file is part of Ewok.
+*
+* Copyright 2017 Vladyslav Usenko, Technical University of Munich.
+* Developed by Vladyslav Usenko <vlad dot usenko at tum dot de>,
+* for more information see <http://vision.in.tum.de/research/robotvision/replanning>.
+* If you use this code, please cite the respective publications as
+* listed on the above website.
+*
+* Ewok is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* Ewok is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with Ewok. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef EWOK_OPTIMIZATION_INCLUDE_EWOK_SPATIAL_HASH_GRID_H_
+#define EWOK_OPTIMIZATION_INCLUDE_EWOK_SPATIAL_HASH_GRID_H_
+
+#include <Eigen/Core>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+namespace ewok {
+
+// Points with a payload in a hash map of cubic cells, for nearest and
+// radius queries while points are added. Points can not be moved or
+// removed, only all cleared. Queries visit the cells around the point
+// and scan all points instead when that would visit more cells than
+// there are points. A cell size close to the usual query radius works
+// best.
+template<typename _Scalar, typename _Payload>
+class SpatialHashGrid {
+ public:
+
+  typedef Eigen::Matrix<_Scalar, 3, 1> Vector3;
+  typedef Eigen::Matrix<int, 3, 1> Vector3i;
+
+  explicit SpatialHashGrid(_Scalar cell_size = 1) :
+      cell_size_(cell_size), size_(0) {}
+
+  // Removes all points and sets a new cell size
+  void clear(_Scalar cell_size) {
+    cell_size_ = cell_size;
+    clear();
+  }
+
+  void clear() {
+    cells_.clear();
+    size_ = 0;
+  }
+
+  inline size_t size() const {
+    return size_;
+  }
+
+  inline bool empty() const {
+    return size_ == 0;
+  }
+
+  void insert(const Vector3 & point, const _Payload & payload) {
+    const Vector3i cell = getCell(point);
+
+    if (size_ == 0) {
+      min_cell_ = max_cell_ = cell;
+    } else {
+      min_cell_ = min_cell_.array().min(cell.array());
+      max_cell_ = max_cell_.array().max(cell.array());
+    }
+
+    cells_[key(cell)].push_back(Entry{point, payload});
+    size_++;
+  }
+
+  // Payload of the point closest to point, the first inserted one of equally
+  // close points in a cell. Must not be empty.
+  _Payload nearest(const Vector3 & point) const {
+    const Vector3i center = getCell(point);
+
+    _Scalar best_dist2 = std::numeric_limits<_Scalar>::infinity();
+    const Entry * best = nullptr;
+
+    // No cells closer than the bounding box of the points
+    const int r_min = std::max(0, std::max((min_cell_ - center).maxCoeff(), (center - max_cell_).maxCoeff()));
+
+    for (int r = r_min; ; r++) {
+      const Vector3i lo = (center.array() - r).max(min_cell_.array());
+      const Vector3i hi = (center.array() + r).min(max_cell_.array());
+
+      if (numCells(lo, hi) > size_) {
+        scanAll(point, best_dist2, best);
+        break;
+      }
+
+      // Cells at Chebyshev distance r from the center, the ones closer
+      // were visited before
+      Vector3i c;
+      for (c[0] = lo[0]; c[0] <= hi[0]; c[0]++) {
+        for (c[1] = lo[1]; c[1] <= hi[1]; c[1]++) {
+          if (std::abs(c[0] - center[0]) == r || std::abs(c[1] - center[1]) == r) {
+            for (c[2] = lo[2]; c[2] <= hi[2]; c[2]++) {
+              visitNearest(c, point, best_dist2, best);
+            }
+          } else {
+            c[2] = center[2] - r;
+            if (c[2] >= lo[2]) visitNearest(c, point, best_dist2, best);
+            c[2] = center[2] + r;
+            if (r > 0 && c[2] <= hi[2]) visitNearest(c, point, best_dist2, best);
+          }
+        }
+      }
+
+      // Points in cells further out are at least r cells away
+      const _Scalar bound = r * cell_size_;
+      if (best && best_dist2 <= bound * bound) break;
+
+      if ((center.array() - r <= min_cell_.array()).all() &&
+          (center.array() + r >= max_cell_.array()).all()) break;
+    }
+
+    return best->payload;
+  }
+
+  // Appends the payloads of all points closer than radius to result
+  void radiusSearch(const Vector3 & point, _Scalar radius, std::vector<_Payload> & result) const {
+    if (size_ == 0) return;
+
+    const _Scalar radius2 = radius * radius;
+
+    const Vector3i lo = getCell(point.array() - radius).array().max(min_cell_.array());
+    const Vector3i hi = getCell(point.array() + radius).array().min(max_cell_.array());
+
+    if ((lo.array() > hi.array()).any()) return;
+
+    if (numCells(lo, hi) > size_) {
+      for (const auto & cell : cells_) {
+        for (const Entry & e : cell.second) {
+          if ((e.point - point).squaredNorm() < radius2) result.push_back(e.payload);
+        }
+      }
+      return;
+    }
+
+    Vector3i c;
+    for (c[0] = lo[0]; c[0] <= hi[0]; c[0]++) {
+      for (c[1] = lo[1]; c[1] <= hi[1]; c[1]++) {
+        for (c[2] = lo[2]; c[2] <= hi[2]; c[2]++) {
+          auto it = cells_.find(key(c));
+          if (it == cells_.end()) continue;
+
+          for (const Entry & e : it->second) {
+            if ((e.point - point).squaredNorm() < radius2) result.push_back(e.payload);
+          }
+        }
+      }
+    }
+  }
+
+ protected:
+
+  struct Entry {
+    Vector3 point;
+    _Payload payload;
+  };
+
+  inline Vector3i getCell(const Vector3 & point) const {
+    return (point / cell_size_).array().floor().template cast<int>();
+  }
+
+  // 21 bits per axis, cells further apart alias but stay correct
+  static inline int64_t key(const Vector3i & cell) {
+    const int64_t mask = (1 << 21) - 1;
+    return ((cell[0] & mask) << 42) | ((cell[1] & mask) << 21) | (cell[2] & mask);
+  }
+
+  static inline size_t numCells(const Vector3i & lo, const Vector3i & hi) {
+    return size_t(hi[0] - lo[0] + 1) * (hi[1] - lo[1] + 1) * (hi[2] - lo[2] + 1);
+  }
+
+  inline void visitNearest(const Vector3i & c, const Vector3 & point,
+                           _Scalar & best_dist2, const Entry * & best) const {
+    auto it = cells_.find(key(c));
+    if (it == cells_.end()) return;
+
+    for (const Entry & e : it->second) {
+      const _Scalar dist2 = (e.point - point).squaredNorm();
+      if (dist2 < best_dist2) {
+        best_dist2 = dist2;
+        best = &e;
+      }
+    }
+  }
+
+  void scanAll(const Vector3 & point, _Scalar & best_dist2, const Entry * & best) const {
+    for (const auto & cell : cells_) {
+      for (const Entry & e : cell.second) {
+        const _Scalar dist2 = (e.point - point).squaredNorm();
+        if (dist2 < best_dist2) {
+          best_dist2 = dist2;
+          best = &e;
+        }
+      }
+    }
+  }
+
+  _Scalar cell_size_;
+  size_t size_;
+
+  Vector3i min_cell_, max_cell_;
+
+  std::unordered_map<int64_t, std::vector<Entry>> cells_;
+};
+
+}  // namespace ewok
+
+#endif  // EWOK_OPTIMIZATION_INCLUDE_EWOK_SPATIAL_HASH_GRID_H_
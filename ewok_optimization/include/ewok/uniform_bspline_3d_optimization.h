@@ -48,7 +48,7 @@ class UniformBSpline3DOptimization {
   typedef std::shared_ptr<UniformBSpline3DOptimization<_N, _Scalar>> Ptr;
 
   UniformBSpline3DOptimization(const Vector3 &start_point, _Scalar dt) :
-      spline_(dt), num_cp_opt(-1), cp_opt_start_idx(_N) {
+      spline_(dt), num_cp_opt(-1), cp_opt_start_idx(_N), num_evaluations_(0) {
     // Make sure initial position is static at starting point
     for (int i = 0; i < _N; i++) {
       spline_.push_back(start_point);
@@ -66,7 +66,7 @@ class UniformBSpline3DOptimization {
 
 
   UniformBSpline3DOptimization(ewok::PolynomialTrajectory3D<10>::Ptr & trajectory, _Scalar dt) :
-      spline_(dt), num_cp_opt(-1), cp_opt_start_idx(_N), trajectory_(trajectory) {
+      spline_(dt), num_cp_opt(-1), cp_opt_start_idx(_N), num_evaluations_(0), trajectory_(trajectory) {
 
     Vector3 start_point = trajectory_->evaluate(0,0);
 
@@ -182,7 +182,13 @@ class UniformBSpline3DOptimization {
 
     spline_.getControlPointsData(x, cp_opt_start_idx, num_cp_opt);
 
+    // The map does not change during the optimization, so collisionError
+    // queries it without locking
+    std::unique_lock<std::mutex> map_lock;
+    if(edrb_.get()) map_lock = edrb_->lockForQueries();
+
     double minf;
+    num_evaluations_ = 0;
     nlopt::result result = optimizer->optimize(x, minf);
 
     spline_.setControlPointsData(x, cp_opt_start_idx, num_cp_opt);
@@ -190,6 +196,11 @@ class UniformBSpline3DOptimization {
     return minf;
   }
 
+  // Number of cost function evaluations of the last optimize call
+  int getNumEvaluations() const {
+    return num_evaluations_;
+  }
+
   void setControlPointsOptimizationStartIdx(int n) {
     cp_opt_start_idx = n;
   }
@@ -283,6 +294,9 @@ class UniformBSpline3DOptimization {
     grad.resize(3*num_cp_opt);
     std::fill(grad.begin(), grad.end(), 0.0);
 
+    std::unique_lock<std::mutex> map_lock;
+    if(edrb_.get()) map_lock = edrb_->lockForQueries();
+
     return collisionError(spline_, 1.0, grad);
   }
 
@@ -296,6 +310,9 @@ class UniformBSpline3DOptimization {
 
     std::vector<double> tmp;
 
+    std::unique_lock<std::mutex> map_lock;
+    if(edrb_.get()) map_lock = edrb_->lockForQueries();
+
     double value = collisionError(spline_, 1.0, tmp);
     for(int i=0; i<3; i++) {
       for (int j = 0; j < num_cp_opt; j++) {
@@ -410,6 +427,8 @@ class UniformBSpline3DOptimization {
 
   double combinedError(const std::vector<double> &x,
                        std::vector<double> &grad) {
+    num_evaluations_++;
+
     UniformBSpline3D <_N, _Scalar> current_spline(spline_);
     current_spline.setControlPointsData(x, cp_opt_start_idx, num_cp_opt);
 
@@ -486,6 +505,7 @@ class UniformBSpline3DOptimization {
 
   }
 
+  // The caller holds the lock from EuclideanDistanceRingBuffer::lockForQueries
   double collisionError(const UniformBSpline3D <_N, _Scalar> & current_spline,
                         double lambda, std::vector<double> &grad) const {
 
@@ -496,42 +516,57 @@ class UniformBSpline3DOptimization {
     int start_segment_idx = cp_opt_start_idx - (_N/2 - 1);
     int end_segment_idx = std::min(cp_opt_start_idx + num_cp_opt + _N/2, spline_.maxValidIdx());
 
+    const int num_segment_samples = segment_grads[0].size();
+    const int num_samples = std::max(0, end_segment_idx - start_segment_idx) * num_segment_samples;
+
+    // Sample the whole window, then query all distances in one call
+    EuclideanDistanceRingBuffer<6>::Matrix3X points(3, num_samples), grads_p;
+    EuclideanDistanceRingBuffer<6>::VectorX dists;
+    std::vector<int> sample_segments(num_samples);
+
     for(int segment_idx = start_segment_idx; segment_idx < end_segment_idx; segment_idx++) {
-      for(int k=0; k<segment_grads[0].size(); k++) {
-        _Scalar current_time = (segment_idx + k/ static_cast<double>(segment_grads[0].size())) * spline_.dt();
+      for(int k=0; k<num_segment_samples; k++) {
+        _Scalar current_time = (segment_idx + k/ static_cast<double>(num_segment_samples)) * spline_.dt();
 
-        int s_i;
-        Vector3 point, grad_p;
-        point = current_spline.evaluate(current_time, 0, s_i);
+        const int j = (segment_idx - start_segment_idx) * num_segment_samples + k;
+        points.col(j) = current_spline.evaluate(current_time, 0, sample_segments[j])
+            .template cast<EuclideanDistanceRingBuffer<6>::Scalar>();
+      }
+    }
 
-        _Scalar dist = edrb_->getDistanceWithGrad(point, grad_p);
+    edrb_->getDistancesWithGradUnlocked(points, dists, grads_p);
 
-        if(dist > distance_threshold_) continue;
+    for(int j=0; j<num_samples; j++) {
+      const int k = j % num_segment_samples;
+      const int s_i = sample_segments[j];
 
-        _Scalar diff = dist - distance_threshold_;
-        _Scalar error = 0.5 * diff * diff / distance_threshold_;
-        total_error += error;
+      _Scalar dist = dists[j];
 
-        //ROS_INFO_STREAM("dist: " << dist << " error: " << error);
+      if(dist > distance_threshold_) continue;
 
-        if (!grad.empty()) {
+      _Scalar diff = dist - distance_threshold_;
+      _Scalar error = 0.5 * diff * diff / distance_threshold_;
+      total_error += error;
 
-          int grad_start_idx = s_i - (_N / 2 - 1);
+      //ROS_INFO_STREAM("dist: " << dist << " error: " << error);
 
-          for (int i = 0; i < _N; i++) {
-            int current_idx = grad_start_idx + i;
-            if (current_idx >= cp_opt_start_idx
-                && current_idx < (cp_opt_start_idx + num_cp_opt)) {
+      if (!grad.empty()) {
 
-              int idx = current_idx - cp_opt_start_idx;
+        int grad_start_idx = s_i - (_N / 2 - 1);
 
-              grad[0 * num_cp_opt + idx] +=
-                  lambda * (diff/distance_threshold_) * grad_p[0] * segment_grads[0][k][i];
-              grad[1 * num_cp_opt + idx] +=
-                  lambda * (diff/distance_threshold_) * grad_p[1] * segment_grads[0][k][i];
-              grad[2 * num_cp_opt + idx] +=
-                  lambda * (diff/distance_threshold_) * grad_p[2] * segment_grads[0][k][i];
-            }
+        for (int i = 0; i < _N; i++) {
+          int current_idx = grad_start_idx + i;
+          if (current_idx >= cp_opt_start_idx
+              && current_idx < (cp_opt_start_idx + num_cp_opt)) {
+
+            int idx = current_idx - cp_opt_start_idx;
+
+            grad[0 * num_cp_opt + idx] +=
+                lambda * (diff/distance_threshold_) * grads_p(0, j) * segment_grads[0][k][i];
+            grad[1 * num_cp_opt + idx] +=
+                lambda * (diff/distance_threshold_) * grads_p(1, j) * segment_grads[0][k][i];
+            grad[2 * num_cp_opt + idx] +=
+                lambda * (diff/distance_threshold_) * grads_p(2, j) * segment_grads[0][k][i];
           }
         }
       }
@@ -625,6 +660,8 @@ class UniformBSpline3DOptimization {
   int num_cp_opt;
   int cp_opt_start_idx;
 
+  int num_evaluations_;
+
   std::shared_ptr<nlopt::opt> optimizer, trajectory_time_optimizer;
 
   EuclideanDistanceRingBuffer<6>::Ptr edrb_;
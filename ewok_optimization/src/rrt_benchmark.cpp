@@ -0,0 +1,249 @@
+/**
+* This file is part of Ewok.
+*
+* Copyright 2017 Vladyslav Usenko, Technical University of Munich.
+* Developed by Vladyslav Usenko <vlad dot usenko at tum dot de>,
+* for more information see <http://vision.in.tum.de/research/robotvision/replanning>.
+* If you use this code, please cite the respective publications as
+* listed on the above website.
+*
+* Ewok is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* Ewok is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with Ewok. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+
+#include <ewok/rrtstar3d.h>
+
+const int POW = 6;
+
+typedef ewok::EuclideanDistanceRingBuffer<POW, int16_t, double> EDRB;
+typedef ewok::RRTStar3D<POW, double> RRT;
+
+// Fills the buffer with a deterministic forest of vertical cylinders.
+void createForest(EDRB::Ptr & edrb, int num_trees)
+{
+    EDRB::PointCloud cloud;
+
+    std::srand(42);
+
+    for (int i = 0; i < num_trees; i++) {
+        double cx = -4 + 8.0 * std::rand() / RAND_MAX;
+        double cy = -4 + 8.0 * std::rand() / RAND_MAX;
+
+        // keep start and goal free
+        if (std::abs(cy) < 0.8 && std::abs(cx) > 3) continue;
+
+        for (double a = 0; a < 2 * M_PI; a += 0.3) {
+            for (double z = 0; z < 3; z += 0.1) {
+                cloud.push_back(Eigen::Vector4d(cx + 0.2 * std::cos(a), cy + 0.2 * std::sin(a), z, 0));
+            }
+        }
+    }
+
+    edrb->insertPointCloud(cloud, Eigen::Vector3d(0, 0, 1.5));
+    edrb->insertPointCloud(cloud, Eigen::Vector3d(0, 0, 1.5));
+}
+
+// Edge check RRTStar3D used before the swept check: 5 points at 0, 1/4,
+// 1/2, 3/4 and 1 of the edge.
+bool sampledEdgeCheck(EDRB::Ptr & edrb, const Eigen::Vector3d & from, const Eigen::Vector3d & to, double radius)
+{
+    for (int i = 0; i <= 4; i++) {
+        if (edrb->isNearObstacle(Eigen::Vector3d(from + 0.25 * i * (to - from)), radius)) return true;
+    }
+    return false;
+}
+
+// Checks random edges up to max_length with the 5 point sampler and the
+// swept check. Collisions missed by each are counted against points
+// sampled every 1/16 of a voxel along the edge.
+void benchmarkEdgeChecks(EDRB::Ptr & edrb, double radius, double max_length, int num_edges)
+{
+    std::srand(7);
+
+    std::vector<Eigen::Vector3d> from(num_edges), to(num_edges);
+    for (int i = 0; i < num_edges; i++) {
+        from[i] = Eigen::Vector3d::Random() * 4;
+        from[i][2] = 1.5 + from[i][2] / 4;
+        to[i] = from[i] + Eigen::Vector3d::Random().normalized() * max_length * std::rand() / RAND_MAX;
+    }
+
+    std::vector<bool> reference(num_edges), sampled(num_edges), swept(num_edges);
+
+    for (int i = 0; i < num_edges; i++) {
+        const int num_points = std::ceil(16 * (to[i] - from[i]).norm() / edrb->getResolution());
+        for (int k = 0; k <= num_points && !reference[i]; k++) {
+            reference[i] = edrb->isNearObstacle(Eigen::Vector3d(from[i] + (to[i] - from[i]) * k / num_points), radius);
+        }
+    }
+
+    auto t1 = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < num_edges; i++) sampled[i] = sampledEdgeCheck(edrb, from[i], to[i], radius);
+    auto t2 = std::chrono::high_resolution_clock::now();
+    double sampled_seconds = std::chrono::duration<double>(t2 - t1).count();
+
+    t1 = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < num_edges; i++) swept[i] = edrb->isSegmentNearObstacle(from[i], to[i], radius);
+    t2 = std::chrono::high_resolution_clock::now();
+    double swept_seconds = std::chrono::duration<double>(t2 - t1).count();
+
+    int num_collisions = 0, sampled_missed = 0, swept_missed = 0;
+    for (int i = 0; i < num_edges; i++) {
+        num_collisions += reference[i];
+        sampled_missed += reference[i] && !sampled[i];
+        swept_missed += reference[i] && !swept[i];
+    }
+
+    std::cout << "max edge [m]: " << max_length
+              << " collisions: " << num_collisions << "/" << num_edges
+              << " sampled [checks/s]: " << num_edges / sampled_seconds
+              << " missed: " << sampled_missed
+              << " swept [checks/s]: " << num_edges / swept_seconds
+              << " missed: " << swept_missed << std::endl;
+}
+
+// Length of the path in the solution marker, which ends at the target
+double pathLength(RRT::Ptr & path_planner)
+{
+    visualization_msgs::Marker marker;
+    path_planner->getSolutionMarker(marker, "path");
+
+    double length = 0;
+    for (size_t i = 1; i < marker.points.size(); i++) {
+        const geometry_msgs::Point & p = marker.points[i - 1], & q = marker.points[i];
+        length += Eigen::Vector3d(q.x - p.x, q.y - p.y, q.z - p.z).norm();
+    }
+
+    return length;
+}
+
+// Plans num_runs times for each number of iterations and prints the mean
+// time and length of the resulting path, with and without the cost
+// propagation to descendants on rewire, see RRTStar3D::setCostPropagation.
+void benchmarkConvergence(EDRB::Ptr & edrb, int num_runs)
+{
+    for (int num_iter = 500; num_iter <= 8000; num_iter *= 2) {
+        std::ostringstream row;
+        row << "iterations: " << num_iter;
+
+        for (bool cost_propagation : {false, true}) {
+            double seconds = 0, length = 0;
+
+            for (int r = 0; r < num_runs; r++) {
+                RRT::Ptr path_planner(new RRT(0.5, 1.15, 0.6, 5, 0.5, num_iter));
+                path_planner->setDistanceBuffer(edrb);
+                path_planner->setCostPropagation(cost_propagation);
+
+                Eigen::Vector3d start_point(-4, 0, 1), end_point(4, 0, 1);
+                path_planner->setStartPoint(start_point);
+                path_planner->setHeight(start_point, true);
+                path_planner->initialize();
+                path_planner->setTargetPoint(end_point);
+
+                auto t1 = std::chrono::high_resolution_clock::now();
+                path_planner->solveRRT_TEST();
+                auto t2 = std::chrono::high_resolution_clock::now();
+
+                seconds += std::chrono::duration<double>(t2 - t1).count();
+                length += pathLength(path_planner);
+            }
+
+            row << (cost_propagation ? " | propagation" : " | no propagation")
+                << " time [s]: " << seconds / num_runs
+                << " path length [m]: " << length / num_runs;
+        }
+
+        std::cout << row.str() << std::endl;
+    }
+}
+
+// Plans num_runs times with num_iter samples for each number of threads.
+// More than one thread grows the tree in batches, see
+// RRTStar3D::extendTreeBatch.
+void benchmarkThreads(EDRB::Ptr & edrb, int num_iter, int num_runs)
+{
+    for (int num_threads = 1; num_threads <= 8; num_threads *= 2) {
+        double seconds = 0, length = 0;
+
+        for (int r = 0; r < num_runs; r++) {
+            RRT::Ptr path_planner(new RRT(0.5, 1.15, 0.6, 5, 0.5, num_iter, num_threads));
+            path_planner->setDistanceBuffer(edrb);
+
+            Eigen::Vector3d start_point(-4, 0, 1), end_point(4, 0, 1);
+            path_planner->setStartPoint(start_point);
+            path_planner->setHeight(start_point, true);
+            path_planner->initialize();
+            path_planner->setTargetPoint(end_point);
+
+            auto t1 = std::chrono::high_resolution_clock::now();
+            path_planner->solveRRT_TEST();
+            auto t2 = std::chrono::high_resolution_clock::now();
+
+            seconds += std::chrono::duration<double>(t2 - t1).count();
+            length += pathLength(path_planner);
+        }
+
+        std::cout << "threads: " << num_threads
+                  << " iterations: " << num_iter
+                  << " time [s]: " << seconds / num_runs
+                  << " iterations/s: " << num_iter * num_runs / seconds
+                  << " path length [m]: " << length / num_runs << std::endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int num_iter = argc > 1 ? std::atoi(argv[1]) : 1000;
+    int num_trees = argc > 2 ? std::atoi(argv[2]) : 20;
+    bool distance_collision_check = argc > 3 ? std::atoi(argv[3]) : 0;
+    int num_runs = argc > 4 ? std::atoi(argv[4]) : 10;
+
+    EDRB::Ptr edrb(new EDRB(0.15, 1.0));
+    edrb->setDistanceCollisionCheck(distance_collision_check);
+    createForest(edrb, num_trees);
+
+    RRT::Ptr path_planner(new RRT(0.5, 1.15, 0.6, 5, 0.5, num_iter));
+    path_planner->setDistanceBuffer(edrb);
+
+    Eigen::Vector3d start_point(-4, 0, 1), end_point(4, 0, 1);
+    path_planner->setStartPoint(start_point);
+    path_planner->setHeight(start_point, true);
+    path_planner->initialize();
+    path_planner->setTargetPoint(end_point);
+
+    auto t1 = std::chrono::high_resolution_clock::now();
+    path_planner->solveRRT_TEST();
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    double seconds = std::chrono::duration<double>(t2 - t1).count();
+
+    std::cout << std::fixed << std::setprecision(3)
+              << "distance check: " << distance_collision_check
+              << " iterations: " << num_iter
+              << " time [s]: " << seconds
+              << " iterations/s: " << num_iter / seconds
+              << " path length [m]: " << pathLength(path_planner) << std::endl;
+
+    benchmarkEdgeChecks(edrb, 0.6, 0.5, 100000);
+    benchmarkEdgeChecks(edrb, 0.6, 2.0, 100000);
+
+    benchmarkConvergence(edrb, num_runs);
+    benchmarkThreads(edrb, num_iter, num_runs);
+
+    return 0;
+}
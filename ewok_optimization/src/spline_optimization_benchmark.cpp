@@ -0,0 +1,145 @@
+/**
+* This file is part of Ewok.
+*
+* Copyright 2017 Vladyslav Usenko, Technical University of Munich.
+* Developed by Vladyslav Usenko <vlad dot usenko at tum dot de>,
+* for more information see <http://vision.in.tum.de/research/robotvision/replanning>.
+* If you use this code, please cite the respective publications as
+* listed on the above website.
+*
+* Ewok is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* Ewok is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with Ewok. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+
+#include <ewok/uniform_bspline_3d_optimization.h>
+
+typedef ewok::EuclideanDistanceRingBuffer<6> EDRB;
+typedef ewok::UniformBSpline3DOptimization<6> SplineOptimization;
+
+// Fills the buffer with a forest of solid vertical cylinders around the
+// straight line from (-4, 0, 1) to (4, 0, 1). The forest is the same for a
+// seed.
+void createForest(EDRB::Ptr & edrb, int num_trees, int seed)
+{
+    EDRB::PointCloud cloud;
+
+    std::srand(seed);
+
+    for (int i = 0; i < num_trees; i++) {
+        float cx = -3 + 6.0f * std::rand() / RAND_MAX;
+        float cy = -1 + 2.0f * std::rand() / RAND_MAX;
+
+        // Solid trunks, every voxel inside is a ray endpoint
+        for (float x = -0.3f; x <= 0.3f; x += 0.05f) {
+            for (float y = -0.3f; y <= 0.3f; y += 0.05f) {
+                if (x * x + y * y > 0.09f) continue;
+                for (float z = 0; z < 3; z += 0.1f) {
+                    cloud.push_back(Eigen::Vector4f(cx + x, cy + y, z, 0));
+                }
+            }
+        }
+    }
+
+    // Two hits make a voxel occupied
+    edrb->insertPointCloud(cloud, Eigen::Vector3f(0, 0, 1.5));
+    edrb->insertPointCloud(cloud, Eigen::Vector3f(0, 0, 1.5));
+    edrb->updateDistance();
+}
+
+// Optimizes a spline starting from the straight line through num_forests
+// forests. Prints the mean time and number of cost evaluations of optimize
+// and the number of results that pass closer than robot_radius to an
+// obstacle, which would need a new path from the planner.
+void benchmarkOptimize(bool tricubic, bool gradient_field, bool signed_distance,
+                       int num_forests, int num_trees)
+{
+    const int num_points = 7;
+    const double robot_radius = 0.3;
+
+    double seconds = 0, cost = 0, gradient_field_mb = 0;
+    int num_evaluations = 0, num_in_collision = 0;
+
+    for (int f = 0; f < num_forests; f++) {
+        EDRB::Ptr edrb(new EDRB(0.15, 1.0, tricubic));
+        edrb->setGradientField(gradient_field);
+        edrb->setSignedDistance(signed_distance);
+        createForest(edrb, num_trees, f + 1);
+        gradient_field_mb = edrb->getGradientFieldBytes() / 1048576.0;
+
+        Eigen::Vector3d start_point(-4, 0, 1);
+        SplineOptimization spline_opt(start_point, 0.5);
+
+        for (int i = 0; i < 5; i++) {
+            spline_opt.addControlPoint(start_point);
+        }
+
+        for (int i = 0; i < num_points; i++) {
+            spline_opt.addControlPoint(start_point + Eigen::Vector3d(1, 0, 0) * (i + 1));
+        }
+
+        spline_opt.setTargetEnpoint(Eigen::Vector3d(4, 0, 1));
+        spline_opt.setNumControlPointsOptimized(num_points);
+        spline_opt.setControlPointOptimizationStartIdx(11);
+        spline_opt.setDistanceBuffer(edrb);
+
+        auto t1 = std::chrono::high_resolution_clock::now();
+        cost += spline_opt.optimize();
+        auto t2 = std::chrono::high_resolution_clock::now();
+
+        seconds += std::chrono::duration<double>(t2 - t1).count();
+        num_evaluations += spline_opt.getNumEvaluations();
+
+        visualization_msgs::MarkerArray markers;
+        spline_opt.getMarkers(markers);
+
+        for (const geometry_msgs::Point & p : markers.markers[0].points) {
+            Eigen::Vector3f grad;
+            if (edrb->getDistanceWithGrad(Eigen::Vector3f(p.x, p.y, p.z), grad) < robot_radius) {
+                num_in_collision++;
+                break;
+            }
+        }
+    }
+
+    std::cout << "tricubic: " << tricubic
+              << " gradient field: " << gradient_field << " (" << gradient_field_mb << " MB)"
+              << " signed: " << signed_distance
+              << " optimize [ms]: " << 1e3 * seconds / num_forests
+              << " evaluations: " << double(num_evaluations) / num_forests
+              << " mean cost: " << cost / num_forests
+              << " in collision: " << num_in_collision << "/" << num_forests << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    int num_forests = argc > 1 ? std::atoi(argv[1]) : 100;
+    int num_trees = argc > 2 ? std::atoi(argv[2]) : 10;
+
+    std::cout << std::fixed << std::setprecision(3);
+
+    benchmarkOptimize(false, false, false, num_forests, num_trees);
+    benchmarkOptimize(false, true, false, num_forests, num_trees);
+    benchmarkOptimize(false, false, true, num_forests, num_trees);
+    benchmarkOptimize(false, true, true, num_forests, num_trees);
+
+    // The gradient field holds trilinear cells and is not used here
+    benchmarkOptimize(true, false, false, num_forests, num_trees);
+    benchmarkOptimize(true, false, true, num_forests, num_trees);
+
+    return 0;
+}
@@ -0,0 +1,125 @@
+/**
+* This file is part of Ewok.
+*
+* Copyright 2017 Vladyslav Usenko, Technical University of Munich.
+* Developed by Vladyslav Usenko <vlad dot usenko at tum dot de>,
+* for more information see <http://vision.in.tum.de/research/robotvision/replanning>.
+* If you use this code, please cite the respective publications as
+* listed on the above website.
+*
+* Ewok is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* Ewok is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with Ewok. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ewok/rrt_tree.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+typedef ewok::RRTTree<double> Tree;
+typedef Tree::Index Index;
+
+// Children of node by following the sibling links
+std::vector<Index> getChildren(const Tree & tree, Index node) {
+  std::vector<Index> children;
+  for (Index c = tree.firstChild(node); c != Tree::NONE; c = tree.nextSibling(c)) {
+    children.push_back(c);
+  }
+  std::sort(children.begin(), children.end());
+  return children;
+}
+
+TEST(RRTTreeTest, TestAddAndSetParent)
+{
+  const int num_nodes = 1000;
+
+  Tree tree;
+  std::vector<Index> parents;
+
+  for (int run = 0; run < 3; run++) {
+    tree.clear();
+    parents.clear();
+    EXPECT_TRUE(tree.empty());
+
+    Index root = tree.addNode(Tree::Vector3::Zero(), 0);
+    parents.push_back(Tree::NONE);
+    EXPECT_EQ(0, root);
+
+    for (int i = 1; i < num_nodes; i++) {
+      Index parent = std::rand() % i;
+      Index node = tree.addNode(Tree::Vector3::Constant(i), i, parent);
+      parents.push_back(parent);
+      EXPECT_EQ(i, node);
+    }
+
+    // Only move nodes below nodes added before them, keeps the tree acyclic
+    for (int i = 0; i < num_nodes; i++) {
+      Index node = 1 + std::rand() % (num_nodes - 1);
+      Index parent = std::rand() % node;
+      tree.setParent(node, parent);
+      tree.setCost(node, -i);
+      parents[node] = parent;
+    }
+
+    ASSERT_EQ(num_nodes, tree.size());
+
+    for (Index n = 0; n < num_nodes; n++) {
+      EXPECT_EQ(parents[n], tree.parent(n));
+      EXPECT_EQ(n, tree.position(n).x());
+
+      std::vector<Index> expected;
+      for (Index c = 0; c < num_nodes; c++) {
+        if (parents[c] == n) expected.push_back(c);
+      }
+
+      EXPECT_EQ(expected, getChildren(tree, n));
+    }
+  }
+}
+
+TEST(RRTTreeTest, TestAddCostToDescendants)
+{
+  const int num_nodes = 1000;
+
+  Tree tree;
+  tree.addNode(Tree::Vector3::Zero(), 0);
+
+  // Cost of a node is the sum of the x coordinates on its path
+  for (int i = 1; i < num_nodes; i++) {
+    Index parent = std::rand() % i;
+    tree.addNode(Tree::Vector3::Constant(i), tree.cost(parent) + i, parent);
+  }
+
+  for (int i = 0; i < num_nodes; i++) {
+    Index node = 1 + std::rand() % (num_nodes - 1);
+    Index parent = std::rand() % node;
+
+    double cost = tree.cost(parent) + node;
+    tree.addCostToDescendants(node, cost - tree.cost(node));
+    tree.setCost(node, cost);
+    tree.setParent(node, parent);
+  }
+
+  for (Index n = 1; n < num_nodes; n++) {
+    EXPECT_NEAR(tree.cost(tree.parent(n)) + n, tree.cost(n), 1e-6);
+  }
+}
+
+
+int main(int argc, char **argv) {
+  //srand((unsigned int) time(0));
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,139 @@
+/**
+* This file is part of Ewok.
+*
+* Copyright 2017 Vladyslav Usenko, Technical University of Munich.
+* Developed by Vladyslav Usenko <vlad dot usenko at tum dot de>,
+* for more information see <http://vision.in.tum.de/research/robotvision/replanning>.
+* If you use this code, please cite the respective publications as
+* listed on the above website.
+*
+* Ewok is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* Ewok is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with Ewok. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ewok/spatial_hash_grid.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+template <typename _Scalar>
+struct TypeDefinitions {
+  typedef _Scalar Scalar;
+};
+
+typedef ::testing::Types <
+                          TypeDefinitions<float>,
+                          TypeDefinitions<double>
+                          > Implementations;
+
+
+
+template <class T>
+class SpatialHashGridTest : public testing::Test {
+};
+
+
+TYPED_TEST_CASE(SpatialHashGridTest, Implementations);
+
+
+template <typename _Scalar>
+Eigen::Matrix<_Scalar, 3, 1> randomPoint(_Scalar size) {
+  return Eigen::Matrix<_Scalar, 3, 1>::Random() * size;
+}
+
+TYPED_TEST(SpatialHashGridTest, TestNearest)
+{
+  typedef typename TypeParam::Scalar Scalar;
+  typedef ewok::SpatialHashGrid<Scalar, int> SpatialHashGridType;
+  typedef typename SpatialHashGridType::Vector3 Vector3;
+
+  const int num_points = 2000;
+  const int num_queries = 1000;
+
+  SpatialHashGridType grid(0.5);
+  std::vector<Vector3> points;
+
+  for (int i = 0; i < num_points; i++) {
+    // Sparse and dense parts and points far away
+    Scalar size = i % 10 == 0 ? 20 : (i % 2 ? 5 : 1);
+    points.push_back(randomPoint(size));
+    grid.insert(points.back(), i);
+
+    if (i % 50 != 0) continue;
+
+    for (int j = 0; j < num_queries / 10; j++) {
+      Vector3 query = randomPoint(Scalar(30));
+
+      int expected = 0;
+      for (int k = 1; k <= i; k++) {
+        if ((points[k] - query).squaredNorm() < (points[expected] - query).squaredNorm()) expected = k;
+      }
+
+      int result = grid.nearest(query);
+
+      EXPECT_FLOAT_EQ((points[expected] - query).norm(), (points[result] - query).norm());
+    }
+  }
+
+  EXPECT_EQ(num_points, grid.size());
+}
+
+TYPED_TEST(SpatialHashGridTest, TestRadiusSearch)
+{
+  typedef typename TypeParam::Scalar Scalar;
+  typedef ewok::SpatialHashGrid<Scalar, int> SpatialHashGridType;
+  typedef typename SpatialHashGridType::Vector3 Vector3;
+
+  const int num_points = 2000;
+  const int num_queries = 1000;
+
+  SpatialHashGridType grid(0.5);
+  std::vector<Vector3> points;
+
+  for (int i = 0; i < num_points; i++) {
+    points.push_back(randomPoint(Scalar(i % 10 == 0 ? 20 : 5)));
+    grid.insert(points.back(), i);
+  }
+
+  for (int j = 0; j < num_queries; j++) {
+    Vector3 query = randomPoint(Scalar(10));
+    Scalar radius = Scalar(3) * std::rand() / RAND_MAX;
+
+    std::vector<int> expected;
+    for (int k = 0; k < num_points; k++) {
+      if ((points[k] - query).squaredNorm() < radius * radius) expected.push_back(k);
+    }
+
+    std::vector<int> result;
+    grid.radiusSearch(query, radius, result);
+    std::sort(result.begin(), result.end());
+
+    EXPECT_EQ(expected, result);
+  }
+
+  grid.clear(1.0);
+  EXPECT_TRUE(grid.empty());
+
+  std::vector<int> result;
+  grid.radiusSearch(Vector3::Zero(), 100, result);
+  EXPECT_TRUE(result.empty());
+}
+
+
+int main(int argc, char **argv) {
+  //srand((unsigned int) time(0));
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -28,34 +28,67 @@
 
 #include <vector>
 #include <deque>
+#include <memory>
+#include <mutex>
+#include <type_traits>
 
 namespace ewok {
 
+// Distances are stored as _Distance. If it is an integer type, they are
+// stored in fixed point with a step of truncation distance / max value.
 template<int _POW, typename _Datatype = int16_t,
-    typename _Scalar = float, typename _Flag = uint8_t>
+    typename _Scalar = float, typename _Flag = uint8_t,
+    template<int> class _Layout = LinearLayout, bool _Interleaved = false,
+    typename _Distance = _Scalar>
 class EuclideanDistanceRingBuffer {
  public:
 
   static const int _N = (1 << _POW);  // 2 to the power of POW
 
   // Other definitions
+  typedef _Scalar Scalar;
   typedef Eigen::Matrix<_Scalar, 4, 1> Vector4;
   typedef Eigen::Matrix<_Scalar, 3, 1> Vector3;
   typedef Eigen::Matrix<int, 3, 1> Vector3i;
+  typedef Eigen::Matrix<_Scalar, 4, 4> Matrix4;
   typedef std::vector <Vector4, Eigen::aligned_allocator<Vector4>> PointCloud;
+  typedef Eigen::Matrix<_Scalar, 3, Eigen::Dynamic> Matrix3X;
+  typedef Eigen::Matrix<_Scalar, Eigen::Dynamic, 1> VectorX;
   typedef std::pair<Vector3, bool> PointBool;
 
-  typedef std::shared_ptr<EuclideanDistanceRingBuffer<_POW, _Datatype, _Scalar, _Flag>> Ptr;
+  typedef std::shared_ptr<EuclideanDistanceRingBuffer<_POW, _Datatype, _Scalar, _Flag, _Layout, _Interleaved, _Distance>> Ptr;
 
+  static const bool _QUANTIZED = std::is_integral<_Distance>::value;
 
-  EuclideanDistanceRingBuffer(const _Scalar &resolution, const _Scalar &truncation_distance) :
+  typedef RaycastRingBuffer<_POW, _Datatype, _Scalar, _Flag, _Layout, _Interleaved> OccupancyBuffer;
+
+
+  // Lines processed together by the vectorized distance transform, the
+  // squared distance that stands for "no obstacle" in its integer passes
+  // and the widest truncation window, in voxels, it scans directly.
+  static const int _EDT_LANES = 8;
+  static const int32_t _EDT_INF = (1 << 29);
+  static const int _EDT_MAX_WINDOW = 32;
+
+
+  // With tricubic_interpolation, getDistanceWithGrad evaluates a uniform
+  // cubic B-spline over the 4x4x4 voxels around the point instead of the
+  // trilinear interpolation of the 8 around it. The distance is then C2 and
+  // the gradient continuous across voxel boundaries. The B-spline smooths
+  // rather than interpolates: it is exact where the distance is linear but
+  // rounds off the ridges between obstacles and the minimum at an obstacle.
+  EuclideanDistanceRingBuffer(const _Scalar &resolution, const _Scalar &truncation_distance,
+                              bool tricubic_interpolation = false) :
       resolution_(resolution),
       truncation_distance_(truncation_distance),
+      distance_scale_(_QUANTIZED ? std::numeric_limits<_Distance>::max() / truncation_distance : 1),
       occupancy_buffer_(resolution),
-      tmp_buffer1_(resolution), tmp_buffer2_(resolution),
-      distance_buffer_(resolution, truncation_distance) {
+      distance_buffer_(resolution, encodeDistance(truncation_distance)),
+      distance_collision_check_(false), vectorized_edt_(false), lazy_edt_(false),
+      signed_distance_(false), tricubic_interpolation_(tricubic_interpolation),
+      esdf_min_bucket_(0) {
 
-    distance_buffer_.setEmptyElement(std::numeric_limits<_Scalar>::max());
+    distance_buffer_.setEmptyElement(std::numeric_limits<_Distance>::max());
 
   }
 
@@ -84,39 +117,243 @@ class EuclideanDistanceRingBuffer {
       occupancy_buffer_.getVolumeMinMax(min_point, max_point);
   }
 
+  // If enabled, isNearObstacle answers with a single lookup in the distance
+  // buffer instead of scanning the occupancy around the point. The distance
+  // check is spherical, so it is slightly more conservative than the cylinder
+  // used by the occupancy check.
+  void setDistanceCollisionCheck(bool enable) {
+    distance_collision_check_ = enable;
+  }
+
+  // If enabled, the distance transform works on exact int32 squared
+  // distances and processes _EDT_LANES neighbouring lines at a time. The
+  // result is the same as with the default floating point transform.
+  void setVectorizedEdt(bool enable) {
+    vectorized_edt_ = enable;
+  }
+
+  // If enabled, updateDistance only marks the bricks within the truncation
+  // distance of a change as stale. getDistanceWithGrad and isNearObstacle
+  // compute the stale bricks they read on first use, so only the region
+  // that is queried is transformed. Has no effect with the incremental
+  // transform.
+  void setLazyEdt(bool enable) {
+    std::lock_guard<std::mutex> lock(distance_mutex_);
+
+    if (lazy_edt_ && !enable) {
+      Vector3i offset;
+      distance_buffer_.getOffset(offset);
+      computeStaleBricks(offset, offset.array() + (_N-1));
+    }
+
+    lazy_edt_ = enable;
+  }
+
+  // If enabled, distances are maintained incrementally instead of being
+  // recomputed over the updated region. Voxels that become occupied or
+  // free start lower and raise wavefronts that only travel as far as the
+  // truncation distance (Lau et al., "Efficient grid-based spatial
+  // representations for robot navigation in dynamic environments").
+  // Obstacles are propagated through the 26-neighbourhood, so in rare cases
+  // a distance can be slightly larger than the exact one.
+  void setIncrementalEdt(bool enable) {
+    std::lock_guard<std::mutex> lock(distance_mutex_);
+
+    occupancy_buffer_.setRecordChangedVoxels(enable);
+
+    // Keys are squared distances up to the truncation window
+    const int window = std::ceil(truncation_distance_ / resolution_) + 1;
+    esdf_buckets_.assign(enable ? window * window + 1 : 0, std::vector<Vector3i>());
+    esdf_min_bucket_ = esdf_buckets_.size();
+
+    if (!enable) {
+      esdf_buffer_.reset();
+      distance_buffer_.setEmptyElement(std::numeric_limits<_Distance>::max());
+      return;
+    }
+
+    Vector3i offset;
+    distance_buffer_.getOffset(offset);
+
+    esdf_buffer_.reset(new RingBufferBase<_POW, EsdfVoxel, _Scalar, _Layout>(
+        resolution_, EsdfVoxel{Vector3i(0, 0, 0), _EDT_INF, false}));
+    esdf_buffer_->setOffset(offset);
+
+    // Voxels entering the volume are far from all obstacles until the
+    // wavefronts reach them.
+    distance_buffer_.setEmptyElement(encodeDistance(truncation_distance_));
+
+    for(int x=0; x<_N; x++) {
+      for(int y=0; y<_N; y++) {
+        for(int z=0; z<_N; z++) {
+          const Vector3i idx = offset + Vector3i(x, y, z);
+          distance_buffer_.at(idx) = encodeDistance(truncation_distance_);
+          if (occupancy_buffer_.isOccupied(idx)) setEsdfObstacle(idx);
+        }
+      }
+    }
+
+    occupancy_buffer_.clearUpdatedMinMax();
+  }
+
+  // If enabled, a second transform on the free space stores the negative
+  // distance to the closest free voxel inside obstacles, so the gradient
+  // still points out of an obstacle. Costs a second transform per update.
+  // With an unsigned _Distance the distances inside are stored as 0. Has
+  // no effect with the incremental transform.
+  void setSignedDistance(bool enable) {
+    std::lock_guard<std::mutex> lock(distance_mutex_);
+
+    if (signed_distance_ == enable) return;
+    signed_distance_ = enable;
+
+    if (esdf_buffer_) return;
+
+    if (lazy_edt_) {
+      stale_bricks_.set();
+    } else {
+      Vector3i offset;
+      distance_buffer_.getOffset(offset);
+      compute_edt3d_core(offset, Vector3i(0, 0, 0), Vector3i(_N-1, _N-1, _N-1));
+    }
+  }
+
+  // If enabled, every voxel also stores the trilinear interpolation of the
+  // cell between it and the voxel at +(1,1,1): the distance, its gradient
+  // and the mixed terms, refreshed wherever the distances change.
+  // getDistanceWithGrad then reads one record instead of 8 distances and
+  // gives the same distance and gradient up to float rounding. The record
+  // is 8 floats whatever _Scalar is, 32 B per voxel: 8 MB for 64^3 and
+  // 64 MB for 128^3 voxels, see getGradientFieldBytes. Not used with
+  // tricubic interpolation.
+  void setGradientField(bool enable) {
+    std::lock_guard<std::mutex> lock(distance_mutex_);
+
+    if (!enable) {
+      gradient_buffer_.reset();
+      return;
+    }
+
+    Vector3i offset;
+    distance_buffer_.getOffset(offset);
+
+    gradient_buffer_.reset(new RingBufferBase<_POW, GradientCell, _Scalar, _Layout>(
+        resolution_, GradientCell{{float(truncation_distance_), 0, 0, 0, 0, 0, 0, 0}}));
+    gradient_buffer_->setOffset(offset);
+    gradient_bricks_.reset();
+
+    updateGradients(offset, Vector3i(0, 0, 0), Vector3i(_N-1, _N-1, _N-1));
+  }
+
+  // Memory of the gradient field, 0 if it is off.
+  size_t getGradientFieldBytes() const {
+    return gradient_buffer_ ? sizeof(GradientCell) * _N * _N * _N : 0;
+  }
+
   inline bool isNearObstacle(const Vector3 & point, const _Scalar & radius_)
   {
-    return occupancy_buffer_.isPointNear(point, radius_+resolution_);
+    const _Scalar rad = radius_ + resolution_;
+
+    std::lock_guard<std::mutex> lock(distance_mutex_);
+    if (distance_collision_check_ && rad <= truncation_distance_) refreshDistance();
+
+    return pointNearObstacle(point, rad, nullptr, lazy_edt_);
+  }
+
+  // Same as isNearObstacle, for callers that hold the lock from
+  // lockForQueries. stencil is getObstacleStencil(radius_). Takes no locks.
+  inline bool isNearObstacleUnlocked(const Vector3 & point, const _Scalar & radius_,
+                                     const std::vector<Vector3i> & stencil)
+  {
+    return pointNearObstacle(point, radius_ + resolution_, &stencil, false);
   }
 
+  // isNearObstacle for all points, for one lock
   inline std::vector<bool> isNearObstacle(const std::vector<Vector3> & points, const _Scalar & radius_)
   {
+      const _Scalar rad = radius_ + resolution_;
+
+      std::lock_guard<std::mutex> lock(distance_mutex_);
+      if (distance_collision_check_ && rad <= truncation_distance_) refreshDistance();
+
+      const std::vector<Vector3i> & stencil = occupancy_buffer_.getNeighborhoodStencil(rad);
+
       std::vector<bool> sol;
       for(Vector3 pt:points)
       {
-          sol.push_back(occupancy_buffer_.isPointNear(pt, radius_+resolution_));
+          sol.push_back(pointNearObstacle(pt, rad, &stencil, lazy_edt_));
       }
       return sol;
   }
 
   inline std::vector<PointBool> isNearObstacle2(const std::vector<Vector3> & points, const _Scalar & radius_)
   {
+      const std::vector<bool> near = isNearObstacle(points, radius_);
+
       std::vector<PointBool> sol;
-      for(Vector3 pt:points)
+      for(size_t i = 0; i < points.size(); i++)
       {
-          sol.push_back(std::make_pair(pt, occupancy_buffer_.isPointNear(pt, radius_+resolution_)));
+          sol.push_back(std::make_pair(points[i], near[i]));
       }
       return sol;
   }
 
+  // Checks the segment from from to to as isNearObstacle checks points.
+  // Walks every voxel the segment passes through (Amanatides and Woo) and
+  // stops at the first one near an obstacle. With the distance collision
+  // check, the clearance of a voxel proves a stretch of the segment free
+  // and the walk jumps over it.
+  inline bool isSegmentNearObstacle(const Vector3 & from, const Vector3 & to, const _Scalar & radius_)
+  {
+    const _Scalar rad = radius_ + resolution_;
+
+    std::lock_guard<std::mutex> lock(distance_mutex_);
+    if (distance_collision_check_ && rad <= truncation_distance_) refreshDistance();
+
+    return segmentNearObstacle(from, to, rad, nullptr, lazy_edt_);
+  }
+
+  // Takes the distance mutex and, with the distance collision check,
+  // brings the distances up to date. In the lazy mode the stale bricks of
+  // the whole volume are computed. While the returned lock is held nothing
+  // changes the buffers, so any number of threads can run the Unlocked
+  // queries at the same time. Inserts and moves on other threads wait
+  // until the lock is released.
+  std::unique_lock<std::mutex> lockForQueries() {
+    std::unique_lock<std::mutex> lock(distance_mutex_);
+
+    if (distance_collision_check_) refreshDistance();
+
+    if (lazy_edt_) {
+      Vector3i offset;
+      distance_buffer_.getOffset(offset);
+      computeStaleBricks(offset, offset.array() + (_N-1));
+    }
+
+    return lock;
+  }
+
+  // Stencil of the occupancy check of the segment queries with radius.
+  const std::vector<Vector3i> & getObstacleStencil(const _Scalar & radius_) {
+    return occupancy_buffer_.getNeighborhoodStencil(radius_ + resolution_);
+  }
+
+  // Same as isSegmentNearObstacle, for callers that hold the lock from
+  // lockForQueries. stencil is getObstacleStencil(radius_). Takes no locks.
+  inline bool isSegmentNearObstacleUnlocked(const Vector3 & from, const Vector3 & to, const _Scalar & radius_,
+                                            const std::vector<Vector3i> & stencil)
+  {
+    return segmentNearObstacle(from, to, radius_ + resolution_, &stencil, false);
+  }
+
   inline bool isOccupied(const Vector3i & idx)
   {
-      occupancy_buffer_.isOccupied(idx);
+      return occupancy_buffer_.isOccupied(idx);
   }
 
   inline bool isFree(const Vector3i & idx)
   {
-      occupancy_buffer_.isFree(idx);
+      return occupancy_buffer_.isFree(idx);
   }
 
   inline bool insideVolume(const Vector3 & point)
@@ -139,27 +376,93 @@ class EuclideanDistanceRingBuffer {
 
   inline _Scalar getResolution() {return resolution_;}
 
+  // Conversion between distances in meters and the stored values. Stored
+  // values are rounded to the closest step, negative ones are 0 for an
+  // unsigned _Distance.
+  inline _Distance encodeDistance(_Scalar d) const {
+    if (!std::is_signed<_Distance>::value) d = std::max(d, _Scalar(0));
+    return _QUANTIZED ? _Distance(std::floor(d * distance_scale_ + _Scalar(0.5))) : _Distance(d);
+  }
+
+  inline _Scalar decodeDistance(_Distance d) const {
+    return _QUANTIZED ? d / distance_scale_ : _Scalar(d);
+  }
+
+  // Number of threads used for ray casting and for the distance transform.
+  void setNumThreads(int num_threads) {
+    occupancy_buffer_.setNumThreads(num_threads);
+
+    std::lock_guard<std::mutex> lock(distance_mutex_);
+    setEdtNumThreads(num_threads);
+  }
+
   void updateDistance() {
+    std::lock_guard<std::mutex> lock(distance_mutex_);
+    compute_edt3d();
+  }
+
+  // Same as updateDistance, but the lines of every EDT pass are split
+  // between num_threads threads. The threads are kept for later updates.
+  void updateDistance(int num_threads) {
+    std::lock_guard<std::mutex> lock(distance_mutex_);
+    setEdtNumThreads(num_threads);
     compute_edt3d();
   }
 
+  // Recomputes the distance buffer only if the occupancy changed since the last update.
+  void updateDistanceIfNeeded() {
+    std::lock_guard<std::mutex> lock(distance_mutex_);
+    refreshDistance();
+  }
+
   void getMapInfo(_Scalar &free_space)
   {
     occupancy_buffer_.getMapInfo(free_space);
   }
 
+  // Inserts, moves, distance updates and the collision and distance
+  // queries hold the distance mutex for the whole call, so they can be
+  // called from different threads. A query then never sees a half moved
+  // volume, and a transform started by a query, see updateDistanceIfNeeded,
+  // can not clear changes it has not seen.
   void insertPointCloud(const PointCloud &cloud, const Vector3 &origin) {
+    std::lock_guard<std::mutex> lock(distance_mutex_);
     occupancy_buffer_.insertPointCloud(cloud, origin);
   }
 
+  void insertDepthImage(const float *data, int width, int height,
+                        const Vector4 &intrinsics, const Matrix4 &T_w_c,
+                        int subsample = 1) {
+    std::lock_guard<std::mutex> lock(distance_mutex_);
+    occupancy_buffer_.insertDepthImage(data, width, height, intrinsics, T_w_c, subsample);
+  }
+
+  void insertDepthImage(const uint16_t *data, int width, int height,
+                        const Vector4 &intrinsics, const Matrix4 &T_w_c,
+                        int subsample = 1, _Scalar depth_scale = 0.001) {
+    std::lock_guard<std::mutex> lock(distance_mutex_);
+    occupancy_buffer_.insertDepthImage(data, width, height, intrinsics, T_w_c, subsample, depth_scale);
+  }
+
   virtual void setOffset(const Vector3i &off) {
     occupancy_buffer_.setOffset(off);
     distance_buffer_.setOffset(off);
+    if (esdf_buffer_) esdf_buffer_->setOffset(off);
+    if (gradient_buffer_) gradient_buffer_->setOffset(off);
   }
 
   virtual void moveVolume(const Vector3i &direction) {
+    std::lock_guard<std::mutex> lock(distance_mutex_);
+
     occupancy_buffer_.moveVolume(direction);
     distance_buffer_.moveVolume(direction);
+
+    if (gradient_buffer_) gradient_buffer_->moveVolume(direction);
+
+    if (esdf_buffer_) {
+      esdf_buffer_->moveVolume(direction);
+      queueEsdfFaces(direction);
+    }
   }
 
   void getMarkerFree(visualization_msgs::Marker & m)  {
@@ -176,9 +479,16 @@ class EuclideanDistanceRingBuffer {
 
   void getMarkerDistance(visualization_msgs::Marker & m, _Scalar distance)  {
 
+    std::lock_guard<std::mutex> lock(distance_mutex_);
+    if (lazy_edt_) {
+      Vector3i offset;
+      distance_buffer_.getOffset(offset);
+      computeStaleBricks(offset, offset.array() + (_N-1));
+    }
+
     distance_buffer_.getMarkerHelper(m, "ring_buffer_distance", 0, Vector4(0, 0, 1, 0.5),
-                          [=](const _Scalar & d)
-                          { return d <= distance;});
+                          [=](const _Distance & d)
+                          { return decodeDistance(d) <= distance;});
   }
 
 
@@ -188,12 +498,314 @@ class EuclideanDistanceRingBuffer {
     Eigen::MatrixBase <Derived> &grad =
         const_cast<Eigen::MatrixBase <Derived> &>(grad_const);
 
-    Vector3 point = point_const.template cast<_Scalar>();
+    std::lock_guard<std::mutex> lock(distance_mutex_);
+
+    Vector3 g;
+    const _Scalar d = interpolateDistance(point_const.template cast<_Scalar>(), g, lazy_edt_);
+    grad = g.template cast<typename Derived::Scalar>();
+
+    return d;
+  }
+
+  // Same as getDistanceWithGrad, for callers that hold the lock from
+  // lockForQueries. Takes no locks.
+  template<class Derived>
+  _Scalar getDistanceWithGradUnlocked(const Eigen::MatrixBase <Derived> & point_const, const Eigen::MatrixBase <Derived> & grad_const) {
+    EIGEN_STATIC_ASSERT_VECTOR_SPECIFIC_SIZE(Derived, 3);
+    Eigen::MatrixBase <Derived> &grad =
+        const_cast<Eigen::MatrixBase <Derived> &>(grad_const);
+
+    Vector3 g;
+    const _Scalar d = interpolateDistance(point_const.template cast<_Scalar>(), g, false);
+    grad = g.template cast<typename Derived::Scalar>();
+
+    return d;
+  }
+
+  // Distances and gradients of the points in the columns of points, as
+  // getDistanceWithGrad gives them one by one, for one lock. The
+  // trilinear interpolation from the distance buffer gathers the corners
+  // of all points first and then interpolates whole rows, which the
+  // compiler vectorizes.
+  void getDistancesWithGrad(const Matrix3X & points, VectorX & distances, Matrix3X & grads) {
+    std::lock_guard<std::mutex> lock(distance_mutex_);
+    distancesWithGrad(points, distances, grads, lazy_edt_);
+  }
+
+  // Same as getDistancesWithGrad, for callers that hold the lock from
+  // lockForQueries. Takes no locks.
+  void getDistancesWithGradUnlocked(const Matrix3X & points, VectorX & distances, Matrix3X & grads) {
+    distancesWithGrad(points, distances, grads, false);
+  }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+ protected:
+
+  // Batch of getDistancesWithGrad. The caller holds the distance mutex, or
+  // the lock from lockForQueries with compute_stale false.
+  void distancesWithGrad(const Matrix3X & points, VectorX & distances, Matrix3X & grads, bool compute_stale) {
+
+    const int num_points = points.cols();
+    distances.resize(num_points);
+    grads.resize(3, num_points);
+
+    if (tricubic_interpolation_ || gradient_buffer_) {
+      Vector3 g;
+      for(int k = 0; k < num_points; k++) {
+        distances[k] = interpolateDistance(points.col(k), g, compute_stale);
+        grads.col(k) = g;
+      }
+      return;
+    }
+
+    // Position in the cell and the corners values[x][y][z] in row 4x+2y+z.
+    // Outside the volume all corners are the truncation distance.
+    Matrix3X t(3, num_points);
+    Eigen::Matrix<_Scalar, 8, Eigen::Dynamic> values(8, num_points);
+
+    Vector3i idx;
+    Vector3 idx_point;
+
+    for(int k = 0; k < num_points; k++) {
+      const Vector3 point_m = points.col(k).array() - 0.5*resolution_;
+      distance_buffer_.getIdx(point_m, idx);
+
+      if (compute_stale) computeStaleBricks(idx, idx + Vector3i(1, 1, 1));
+
+      if (!distance_buffer_.insideVolume(idx) || !distance_buffer_.insideVolume(idx + Vector3i(1, 1, 1))) {
+        t.col(k).setZero();
+        values.col(k).setConstant(truncation_distance_);
+        continue;
+      }
+
+      distance_buffer_.getPoint(idx, idx_point);
+      t.col(k) = (points.col(k) - idx_point)/resolution_;
+
+      for(int c = 0; c < 8; c++) {
+        values(c, k) = decodeDistance(distance_buffer_.at(idx + Vector3i(c >> 2, (c >> 1) & 1, c & 1)));
+      }
+    }
+
+    typedef Eigen::Array<_Scalar, 1, Eigen::Dynamic> RowArray;
+
+    const RowArray u = t.row(0).array(), v = t.row(1).array(), w = t.row(2).array();
+
+    // Along x, then y, then z as in getDistanceWithGrad
+    const RowArray v00 = (1-u)*values.row(0).array() + u*values.row(4).array();
+    const RowArray v01 = (1-u)*values.row(1).array() + u*values.row(5).array();
+    const RowArray v10 = (1-u)*values.row(2).array() + u*values.row(6).array();
+    const RowArray v11 = (1-u)*values.row(3).array() + u*values.row(7).array();
+
+    const RowArray v0 = (1-v)*v00 + v*v10;
+    const RowArray v1 = (1-v)*v01 + v*v11;
+
+    distances = ((1-w)*v0 + w*v1).matrix().transpose();
+
+    grads.row(2) = ((v1 - v0)/resolution_).matrix();
+    grads.row(1) = (((1-w)*(v10 - v00) + w*(v11 - v01))/resolution_).matrix();
+    grads.row(0) = (((1-w)*((1-v)*(values.row(4) - values.row(0)).array() + v*(values.row(6) - values.row(2)).array())
+        + w*((1-v)*(values.row(5) - values.row(1)).array() + v*(values.row(7) - values.row(3)).array()))/resolution_).matrix();
+  }
+
+  // Recomputes the distance buffer if the occupancy changed since the last
+  // update. The caller holds the distance mutex.
+  void refreshDistance() {
+    if (occupancy_buffer_.hasUpdatedRegion()) compute_edt3d();
+  }
+
+  // Check of isNearObstacle for rad = radius + resolution. The caller
+  // holds the distance mutex, or the lock from lockForQueries with
+  // compute_stale false. stencil is resolved on the occupancy check if it
+  // is null.
+  bool pointNearObstacle(const Vector3 & point, const _Scalar & rad,
+                         const std::vector<Vector3i> * stencil, bool compute_stale)
+  {
+    if (distance_collision_check_ && rad <= truncation_distance_) {
+      Vector3i idx;
+      distance_buffer_.getIdx(point, idx);
+
+      if (distance_buffer_.insideVolume(idx)) {
+        if (compute_stale) computeStaleBricks(idx, idx);
+
+        return decodeDistance(distance_buffer_.at(idx)) < rad;
+      }
+    }
+
+    if (!stencil) stencil = &occupancy_buffer_.getNeighborhoodStencil(rad);
+    return occupancy_buffer_.isPointNear(point, *stencil);
+  }
+
+  // Walk of isSegmentNearObstacle for rad = radius + resolution. The
+  // caller holds the distance mutex, or the lock from lockForQueries with
+  // compute_stale false. stencil is resolved on the first voxel checked by
+  // occupancy if it is null.
+  bool segmentNearObstacle(const Vector3 & from, const Vector3 & to, const _Scalar & rad,
+                           const std::vector<Vector3i> * stencil, bool compute_stale)
+  {
+    const bool use_distance = distance_collision_check_ && rad <= truncation_distance_;
+
+    const _Scalar length = (to - from).norm();
+    const Vector3 dir = length > 0 ? Vector3((to - from) / length) : Vector3(1, 0, 0);
+
+    // from a voxel center to any point of the voxel
+    const _Scalar half_diagonal = 0.5 * std::sqrt(_Scalar(3)) * resolution_;
+    const _Scalar inf = std::numeric_limits<_Scalar>::infinity();
+
+    Vector3i step;
+    Vector3 t_delta, inv_dir;
+    for(int i = 0; i < 3; i++) {
+      step[i] = dir[i] > 0 ? 1 : (dir[i] < 0 ? -1 : 0);
+      inv_dir[i] = dir[i] != 0 ? 1 / dir[i] : inf;
+      t_delta[i] = resolution_ * std::abs(inv_dir[i]);
+    }
+
+    // t is the distance from from along the segment
+    _Scalar t = 0;
+
+    while (true) {
+      const Vector3 start = from + dir * t;
+
+      Vector3i idx;
+      Vector3 t_max;
+      distance_buffer_.getIdx(start, idx);
+
+      for(int i = 0; i < 3; i++) {
+        if (step[i] == 0) {
+          t_max[i] = inf;
+        } else {
+          t_max[i] = t + ((idx[i] + (step[i] > 0)) * resolution_ - start[i]) * inv_dir[i];
+        }
+      }
+
+      _Scalar t_jump = -1;
+
+      while (true) {
+        int axis;
+        const _Scalar t_exit = t_max.minCoeff(&axis);
+
+        Vector3 center;
+        getPoint(idx, center);
+
+        if (use_distance && distance_buffer_.insideVolume(idx)) {
+          if (compute_stale) computeStaleBricks(idx, idx);
+
+          const _Scalar d = decodeDistance(distance_buffer_.at(idx));
+          if (d < rad) return true;
+
+          // Voxels with the center within d - rad of this center are free,
+          // so is the segment within clearance of it. Jump if that covers
+          // the segment from the exit of this voxel on and skips more than
+          // a voxel, shorter jumps cost more than the lookups they save.
+          const _Scalar clearance = d - rad - half_diagonal;
+
+          if (clearance > 0) {
+            const Vector3 to_center = center - from;
+            const _Scalar t_center = to_center.dot(dir);
+            const _Scalar half_chord2 = clearance * clearance - (to_center.squaredNorm() - t_center * t_center);
+
+            if (half_chord2 > 0) {
+              const _Scalar half_chord = std::sqrt(half_chord2);
+
+              if (t_center - half_chord <= t_exit && t_center + half_chord > t_exit + resolution_) {
+                t_jump = t_center + half_chord;
+                break;
+              }
+            }
+          }
+        } else {
+          if (!stencil) stencil = &occupancy_buffer_.getNeighborhoodStencil(rad);
+          if (occupancy_buffer_.isPointNear(center, *stencil)) return true;
+        }
+
+        if (t_exit > length) return false;
+
+        idx[axis] += step[axis];
+        t_max[axis] += t_delta[axis];
+      }
+
+      if (t_jump > length) return false;
+      t = t_jump;
+    }
+  }
+
+  void compute_edt3d() {
+
+    Vector3i offset;
+    distance_buffer_.getOffset(offset);
+
+    if (esdf_buffer_) {
+      update_esdf();
+      if (gradient_buffer_) updateGradientBricks(offset);
+      occupancy_buffer_.clearUpdatedMinMax();
+      return;
+    }
+
+    if (lazy_edt_) {
+      markStaleBricks(offset);
+      occupancy_buffer_.clearUpdatedMinMax();
+      return;
+    }
+
+    std::vector<std::pair<Vector3i, Vector3i>> boxes;
+    getEdtBoxes(offset, boxes);
+
+    for(const std::pair<Vector3i, Vector3i> & box : boxes) {
+      compute_edt3d_core(offset, box.first, box.second);
+    }
+
+    occupancy_buffer_.clearUpdatedMinMax();
+
+  }
+
+  // Distance and gradient at a point, see getDistanceWithGrad. The caller
+  // holds the distance mutex, or the lock from lockForQueries with
+  // compute_stale false. The gradient is zero where
+  // the truncation distance is returned for leaving the volume.
+  _Scalar interpolateDistance(const Vector3 & point, Vector3 & grad, bool compute_stale) {
     Vector3 point_m = point.array() - 0.5*resolution_;
 
     Vector3i idx;
     distance_buffer_.getIdx(point_m, idx);
 
+    if (tricubic_interpolation_) {
+      if (compute_stale) computeStaleBricks(idx - Vector3i(1, 1, 1), idx + Vector3i(2, 2, 2));
+
+      Vector3 idx_point;
+      distance_buffer_.getPoint(idx, idx_point);
+
+      const _Scalar d = getDistanceWithGradTricubic(idx, (point - idx_point)/resolution_, grad);
+      grad /= resolution_;
+
+      return d;
+    }
+
+    if (gradient_buffer_) {
+      if (compute_stale) computeStaleBricks(idx, idx + Vector3i(1, 1, 1));
+
+      if (!distance_buffer_.insideVolume(idx) || !distance_buffer_.insideVolume(idx + Vector3i(1, 1, 1))) {
+        grad.setZero();
+        return truncation_distance_;
+      }
+
+      Vector3 idx_point;
+      distance_buffer_.getPoint(idx, idx_point);
+
+      const _Scalar u = (point[0] - idx_point[0])/resolution_;
+      const _Scalar v = (point[1] - idx_point[1])/resolution_;
+      const _Scalar w = (point[2] - idx_point[2])/resolution_;
+
+      const float * c = gradient_buffer_->at(idx).coeff;
+
+      grad[0] = (c[1] + c[4]*v + c[5]*w + c[7]*v*w)/resolution_;
+      grad[1] = (c[2] + c[4]*u + c[6]*w + c[7]*u*w)/resolution_;
+      grad[2] = (c[3] + c[5]*u + c[6]*v + c[7]*u*v)/resolution_;
+
+      return c[0] + u*(c[1] + c[4]*v) + v*c[2] + w*(c[3] + c[5]*u + c[6]*v + c[7]*u*v);
+    }
+
+    if (compute_stale) computeStaleBricks(idx, idx + Vector3i(1, 1, 1));
+
     Vector3 idx_point, diff;
     distance_buffer_.getPoint(idx, idx_point);
 
@@ -209,7 +821,7 @@ class EuclideanDistanceRingBuffer {
           Vector3i current_idx = idx + Vector3i(x,y,z);
 
           if(distance_buffer_.insideVolume(current_idx)) {
-            values[x][y][z] = distance_buffer_.at(current_idx);
+            values[x][y][z] = decodeDistance(distance_buffer_.at(current_idx));
           } else {
             all_valid = false;
           }
@@ -246,65 +858,938 @@ class EuclideanDistanceRingBuffer {
       return v;
 
     } else {
+      grad.setZero();
       return truncation_distance_;
     }
 
   }
 
-  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  // Uniform cubic B-spline weights of the samples at -1, 0, 1 and 2 for a
+  // point at t in [0, 1) from sample 0, and their derivatives in t.
+  static inline void cubicBSplineWeights(_Scalar t, _Scalar w[4], _Scalar dw[4]) {
+    const _Scalar t2 = t*t, t3 = t2*t, s = 1 - t;
 
- protected:
+    w[0] = s*s*s/6;
+    w[1] = (3*t3 - 6*t2 + 4)/6;
+    w[2] = (-3*t3 + 3*t2 + 3*t + 1)/6;
+    w[3] = t3/6;
 
+    dw[0] = -s*s/2;
+    dw[1] = (3*t2 - 4*t)/2;
+    dw[2] = (-3*t2 + 2*t + 1)/2;
+    dw[3] = t2/2;
+  }
 
-  void compute_edt3d() {
+  // Tricubic B-spline of the distances around idx at fraction t of the cell
+  // to idx + (1,1,1). The gradient is in voxel units. Returns the
+  // truncation distance if the stencil leaves the volume.
+  _Scalar getDistanceWithGradTricubic(const Vector3i & idx, const Vector3 & t, Vector3 & grad) {
 
-    Vector3i offset;
-    distance_buffer_.getOffset(offset);
+    if (!distance_buffer_.insideVolume(idx - Vector3i(1, 1, 1)) ||
+        !distance_buffer_.insideVolume(idx + Vector3i(2, 2, 2))) {
+      grad.setZero();
+      return truncation_distance_;
+    }
+
+    _Scalar wx[4], wy[4], wz[4], dwx[4], dwy[4], dwz[4];
+    cubicBSplineWeights(t[0], wx, dwx);
+    cubicBSplineWeights(t[1], wy, dwy);
+    cubicBSplineWeights(t[2], wz, dwz);
+
+    // Separable: lines along x, then planes along y, then z
+    _Scalar value = 0;
+    grad.setZero();
+
+    Vector3i current_idx;
+    for(int z = 0; z < 4; z++) {
+      _Scalar vz = 0, gxz = 0, gyz = 0;
+
+      for(int y = 0; y < 4; y++) {
+        _Scalar vy = 0, gxy = 0;
+
+        for(int x = 0; x < 4; x++) {
+          current_idx = idx + Vector3i(x-1, y-1, z-1);
+          const _Scalar d = decodeDistance(distance_buffer_.at(current_idx));
+          vy += wx[x]*d;
+          gxy += dwx[x]*d;
+        }
+
+        vz += wy[y]*vy;
+        gxz += wy[y]*gxy;
+        gyz += dwy[y]*vy;
+      }
+
+      value += wz[z]*vz;
+      grad[0] += wz[z]*gxz;
+      grad[1] += wz[z]*gyz;
+      grad[2] += dwz[z]*vz;
+    }
+
+    return value;
+  }
+
+  // Distances change up to this many voxels away from a changed voxel
+  inline int getEdtBand() const {
+    return std::ceil(truncation_distance_ / resolution_);
+  }
 
-    Vector3i min_vec, max_vec;
-    occupancy_buffer_.getUpdatedMinMax(min_vec, max_vec);
+  // Computes the distances of the box [core_min, core_max] in volume
+  // coordinates with the selected transform.
+  void compute_edt3d_core(const Vector3i & offset, const Vector3i & core_min, const Vector3i & core_max) {
 
-    min_vec -= offset;
-    max_vec -= offset;
+    const int band = getEdtBand();
 
-    min_vec.array() -= truncation_distance_/resolution_;
-    max_vec.array() += truncation_distance_/resolution_;
+    // Obstacles up to band voxels outside the box are seen by the passes
+    Vector3i min_vec = core_min.array() - band;
+    Vector3i max_vec = core_max.array() + band;
 
     min_vec.array() = min_vec.array().max(Vector3i(0,0,0).array());
     max_vec.array() = max_vec.array().min(Vector3i(_N-1,_N-1,_N-1).array());
 
     //ROS_INFO_STREAM("min_vec: " << min_vec.transpose() << " max_vec: " << max_vec.transpose());
 
-    for(int x=min_vec[0]; x<=max_vec[0]; x++) {
-      for(int y=min_vec[1]; y<=max_vec[1]; y++) {
+    // The signed distance transforms the free space into the obstacles
+    for(int inside=0; inside<=signed_distance_; inside++) {
+      if (vectorized_edt_) {
+        compute_edt3d_vectorized(offset, min_vec, max_vec, core_min, core_max, inside);
+      } else {
+        compute_edt3d_box(offset, min_vec, max_vec, core_min, core_max, inside);
+      }
+    }
 
-        fill_edt([&](int z) {return occupancy_buffer_.isOccupied(offset + Vector3i(x,y,z)) ? 0 : std::numeric_limits<_Scalar>::max();},
-                 [&](int z, _Scalar val) {tmp_buffer1_.at(Vector3i(x,y,z)) = val;},
-                 min_vec[2], max_vec[2]);
+    // Cells up to one voxel below the core have corners in it
+    if (gradient_buffer_) {
+      updateGradients(offset, core_min - Vector3i(1, 1, 1), core_max);
+    }
+  }
+
+  // Recomputes the interpolation cells of the voxels [min_vec, max_vec] in
+  // volume coordinates. Cells at the upper faces have corners outside the
+  // volume and are skipped. Distances that are not computed yet count as
+  // the truncation distance.
+  void updateGradients(const Vector3i & offset, const Vector3i & min_vec, const Vector3i & max_vec) {
+
+    const Vector3i lo = min_vec.array().max(Vector3i(0,0,0).array());
+    const Vector3i hi = max_vec.array().min(Vector3i(_N-2,_N-2,_N-2).array());
+
+    parallelEdtForChunks(lo[0], hi[0], [&](int x_begin, int x_end) {
+      for(int x=x_begin; x<x_end; x++) {
+        for(int y=lo[1]; y<=hi[1]; y++) {
+          for(int z=lo[2]; z<=hi[2]; z++) {
+            const Vector3i idx = offset + Vector3i(x, y, z);
+
+            _Scalar d[2][2][2];
+            for(int i=0; i<8; i++) {
+              const Vector3i corner = idx + Vector3i(i >> 2, (i >> 1) & 1, i & 1);
+              d[i >> 2][(i >> 1) & 1][i & 1] =
+                  std::min(decodeDistance(distance_buffer_.at(corner)), truncation_distance_);
+            }
+
+            float * c = gradient_buffer_->at(idx).coeff;
+            c[0] = d[0][0][0];
+            c[1] = d[1][0][0] - d[0][0][0];
+            c[2] = d[0][1][0] - d[0][0][0];
+            c[3] = d[0][0][1] - d[0][0][0];
+            c[4] = d[1][1][0] - d[1][0][0] - d[0][1][0] + d[0][0][0];
+            c[5] = d[1][0][1] - d[1][0][0] - d[0][0][1] + d[0][0][0];
+            c[6] = d[0][1][1] - d[0][1][0] - d[0][0][1] + d[0][0][0];
+            c[7] = d[1][1][1] - d[1][1][0] - d[1][0][1] - d[0][1][1]
+                + d[1][0][0] + d[0][1][0] + d[0][0][1] - d[0][0][0];
+          }
+        }
+      }
+    });
+  }
+
+  // Recomputes the cells around the bricks whose distances the incremental
+  // transform changed, and around the dirty bricks of the occupancy, which
+  // include the faces of a move.
+  void updateGradientBricks(const Vector3i & offset) {
+
+    static const int B = OccupancyBuffer::_BRICK_N;
+
+    const Vector3i first_brick = OccupancyBuffer::getBrick(offset);
+    const Vector3i last_brick = OccupancyBuffer::getBrick(offset.array() + (_N-1));
+
+    Vector3i b;
+    for(b[0]=first_brick[0]; b[0]<=last_brick[0]; b[0]++) {
+      for(b[1]=first_brick[1]; b[1]<=last_brick[1]; b[1]++) {
+        for(b[2]=first_brick[2]; b[2]<=last_brick[2]; b[2]++) {
+          if (!gradient_bricks_[OccupancyBuffer::brickSlot(b)] && !occupancy_buffer_.isBrickDirty(b)) continue;
+
+          const Vector3i brick_min = b * B - offset;
+          updateGradients(offset, brick_min - Vector3i(1, 1, 1), brick_min + Vector3i(B-1, B-1, B-1));
+        }
+      }
+    }
+
+    gradient_bricks_.reset();
+  }
+
+  // Adds all bricks within the band of a dirty brick to the stale bricks.
+  void markStaleBricks(const Vector3i & offset) {
+
+    Vector3i first_brick, num_bricks;
+    std::vector<uint8_t> dirty, region;
+    getDirtyRegion(offset, first_brick, num_bricks, dirty, region);
+
+    Vector3i b;
+    for(b[0]=0; b[0]<num_bricks[0]; b[0]++) {
+      for(b[1]=0; b[1]<num_bricks[1]; b[1]++) {
+        for(b[2]=0; b[2]<num_bricks[2]; b[2]++) {
+          if (region[(b[0] * num_bricks[1] + b[1]) * num_bricks[2] + b[2]]) {
+            stale_bricks_.set(OccupancyBuffer::brickSlot(first_brick + b));
+          }
+        }
+      }
+    }
+  }
+
+  // Computes the stale bricks that overlap the voxels [min_idx, max_idx]
+  // in one box. Changes that are not yet marked are marked first. The
+  // caller holds distance_mutex_.
+  void computeStaleBricks(const Vector3i & min_idx, const Vector3i & max_idx) {
+
+    if (esdf_buffer_) return;
+
+    Vector3i offset;
+    distance_buffer_.getOffset(offset);
+
+    if (occupancy_buffer_.hasUpdatedRegion()) {
+      markStaleBricks(offset);
+      occupancy_buffer_.clearUpdatedMinMax();
+    }
+
+    if (stale_bricks_.none()) return;
+
+    Vector3i min_clamped = min_idx.array().max(offset.array());
+    Vector3i max_clamped = max_idx.array().min(offset.array() + (_N-1));
+
+    const Vector3i first_brick = OccupancyBuffer::getBrick(min_clamped);
+    const Vector3i last_brick = OccupancyBuffer::getBrick(max_clamped);
+
+    Vector3i stale_min = last_brick, stale_max = first_brick;
+    bool any = false;
+
+    Vector3i b;
+    for(b[0]=first_brick[0]; b[0]<=last_brick[0]; b[0]++) {
+      for(b[1]=first_brick[1]; b[1]<=last_brick[1]; b[1]++) {
+        for(b[2]=first_brick[2]; b[2]<=last_brick[2]; b[2]++) {
+          if (!stale_bricks_[OccupancyBuffer::brickSlot(b)]) continue;
+          stale_min = stale_min.array().min(b.array());
+          stale_max = stale_max.array().max(b.array());
+          any = true;
+        }
       }
     }
 
+    if (!any) return;
+
+    computeBricks(offset, stale_min, stale_max);
+
+    // Bricks that stick out of the volume share their slot with the brick
+    // at the opposite face, which has to be computed as well.
+    for(b[0]=stale_min[0]; b[0]<=stale_max[0]; b[0]++) {
+      for(b[1]=stale_min[1]; b[1]<=stale_max[1]; b[1]++) {
+        for(b[2]=stale_min[2]; b[2]<=stale_max[2]; b[2]++) {
+          const int slot = OccupancyBuffer::brickSlot(b);
+          if (!stale_bricks_[slot]) continue;
+
+          Vector3i k;
+          for(k[0]=-1; k[0]<=1; k[0]++) {
+            for(k[1]=-1; k[1]<=1; k[1]++) {
+              for(k[2]=-1; k[2]<=1; k[2]++) {
+                const Vector3i partner = b + k * OccupancyBuffer::_NUM_BRICKS;
+                if (k != Vector3i(0, 0, 0)) computeBricks(offset, partner, partner);
+              }
+            }
+          }
+
+          stale_bricks_.reset(slot);
+        }
+      }
+    }
+  }
+
+  // Computes the distances of the bricks [first_brick, last_brick] that
+  // lie inside the volume.
+  void computeBricks(const Vector3i & offset, const Vector3i & first_brick, const Vector3i & last_brick) {
+
+    static const int B = OccupancyBuffer::_BRICK_N;
+
+    Vector3i core_min = first_brick * B - offset;
+    Vector3i core_max = (last_brick + Vector3i(1, 1, 1)) * B - Vector3i(1, 1, 1) - offset;
+
+    core_min.array() = core_min.array().max(Vector3i(0,0,0).array());
+    core_max.array() = core_max.array().min(Vector3i(_N-1,_N-1,_N-1).array());
+
+    if ((core_min.array() <= core_max.array()).all()) {
+      compute_edt3d_core(offset, core_min, core_max);
+    }
+  }
+
+  // Distance transform of the box [min_vec, max_vec] in volume coordinates.
+  // Only the distances inside [core_min, core_max] are written, they are
+  // exact as long as the box extends the core by the truncation distance.
+  // Passes 1 (along z) and 2 (along y) transform one x plane at a time
+  // through a line of scratch, see transform_planes for pass 3. If inside
+  // is set, the distances to the free voxels are written to the occupied
+  // ones instead, negated.
+  void compute_edt3d_box(const Vector3i & offset, const Vector3i & min_vec, const Vector3i & max_vec,
+                         const Vector3i & core_min, const Vector3i & core_max, bool inside) {
+
+    transform_planes<_Scalar>(offset, min_vec, max_vec, core_min, core_max, inside,
+                              [&](int x, _Scalar * plane, _Scalar * scratch) {
+
+      for(int y=min_vec[1]; y<=max_vec[1]; y++) {
+        _Scalar * row = plane + (y - min_vec[1]) * _N;
+
+        fill_edt([&](int z) {return occupancy_buffer_.isOccupied(offset + Vector3i(x,y,z)) != inside ? 0 : std::numeric_limits<_Scalar>::max();},
+                 [&](int z, _Scalar val) {row[z - min_vec[2]] = val;},
+                 min_vec[2], max_vec[2]);
+      }
 
-    for(int x=min_vec[0]; x<=max_vec[0]; x++) {
       for(int z=min_vec[2]; z<=max_vec[2]; z++) {
-        fill_edt([&](int y) {return tmp_buffer1_.at(Vector3i(x,y,z));},
-                 [&](int y, _Scalar val) {tmp_buffer2_.at(Vector3i(x,y,z)) = val;},
+        _Scalar * column = plane + z - min_vec[2];
+
+        for(int y=min_vec[1]; y<=max_vec[1]; y++) scratch[y] = column[(y - min_vec[1]) * _N];
+
+        fill_edt([&](int y) {return scratch[y];},
+                 [&](int y, _Scalar val) {column[(y - min_vec[1]) * _N] = val;},
                  min_vec[1], max_vec[1]);
       }
+    });
+  }
+
+  // Same transform as compute_edt3d_box, on int32 squared distances.
+  // Pass 1 (along z) only sees 0 and infinity, so it is the distance to the
+  // closest occupied voxel on the line. It is computed for _EDT_LANES
+  // neighbouring lines at once with a forward and a backward min sweep.
+  // Pass 2 transforms the whole plane at once, see edt_rows.
+  void compute_edt3d_vectorized(const Vector3i & offset, const Vector3i & min_vec, const Vector3i & max_vec,
+                                const Vector3i & core_min, const Vector3i & core_max, bool inside) {
+
+    static const int L = _EDT_LANES;
+    static const int32_t max_1d = 2 * _N;
+    const int32_t inf = _EDT_INF;
+
+    const int ny = max_vec[1] - min_vec[1] + 1;
+    const int nz = max_vec[2] - min_vec[2] + 1;
+
+    const int window = std::ceil(truncation_distance_ / resolution_) + 1;
+
+    transform_planes<int32_t>(offset, min_vec, max_vec, core_min, core_max, inside,
+                              [&](int x, int32_t * plane, int32_t * scratch) {
+
+      int32_t block[_N * L];
+
+      for(int y0=min_vec[1]; y0<=max_vec[1]; y0+=L) {
+        const int lanes = std::min(L, max_vec[1] - y0 + 1);
+
+        for(int l=0; l<L; l++) {
+          for(int i=0; i<nz; i++) {
+            block[i*L + l] = (l < lanes && occupancy_buffer_.isOccupied(offset + Vector3i(x, y0 + l, min_vec[2] + i)) != inside) ? 0 : max_1d;
+          }
+        }
+
+        for(int i=1; i<nz; i++) {
+          for(int l=0; l<L; l++) {
+            block[i*L + l] = std::min(block[i*L + l], block[(i-1)*L + l] + 1);
+          }
+        }
+
+        for(int i=nz-2; i>=0; i--) {
+          for(int l=0; l<L; l++) {
+            block[i*L + l] = std::min(block[i*L + l], block[(i+1)*L + l] + 1);
+          }
+        }
+
+        for(int l=0; l<lanes; l++) {
+          int32_t * row = scratch + (y0 + l - min_vec[1]) * _N;
+          for(int i=0; i<nz; i++) {
+            const int32_t d = block[i*L + l];
+            row[i] = d < max_1d ? d * d : inf;
+          }
+        }
+      }
+
+      edt_rows(scratch, plane, ny, nz, window);
+    });
+  }
+
+  // Pass 3 of the distance transform (along x), shared by both transforms.
+  // compute_plane(x, plane, scratch) writes the squared distances within
+  // the x plane to plane, as [y][z] relative to min_vec with rows of _N
+  // values. scratch has room for a plane. The core is transformed in slabs
+  // of 2 * window + 1 planes along x. A slab needs the planes up to the
+  // window beyond it, farther planes are above the truncation distance.
+  // Only these planes are kept, the ones shared with the previous slab are
+  // not computed again, so no buffer of the size of the volume is needed.
+  // The rows of one y through the kept planes are then transformed along
+  // x with transform_rows. If inside is set, only the voxels that are not
+  // sources of the transform are written, negated.
+  template<typename T, typename F>
+  void transform_planes(const Vector3i & offset, const Vector3i & min_vec, const Vector3i & max_vec,
+                        const Vector3i & core_min, const Vector3i & core_max, bool inside, F compute_plane) {
+
+    const int nx = max_vec[0] - min_vec[0] + 1;
+    const int ny = max_vec[1] - min_vec[1] + 1;
+    const int nz = core_max[2] - core_min[2] + 1;
+
+    const int window = std::ceil(truncation_distance_ / resolution_) + 1;
+    const int slab = 2 * window + 1;
+    const int num_planes = std::min(slab + 2 * window, nx);
+
+    // x of the plane in every slot, slots are used round robin
+    std::vector<T> planes(num_planes * ny * _N);
+    std::vector<int> plane_x(num_planes, min_vec[0] - 1);
+
+    auto plane_at = [&](int x) {
+      return planes.data() + ((x - min_vec[0]) % num_planes) * ny * _N;
+    };
+
+    std::vector<int> new_planes;
+
+    for(int x_begin=core_min[0]; x_begin<=core_max[0]; x_begin+=slab) {
+      const int x_end = std::min(x_begin + slab - 1, core_max[0]);
+      const int x_first = std::max(min_vec[0], x_begin - window);
+      const int x_last = std::min(max_vec[0], x_end + window);
+      const int n = x_last - x_first + 1;
+
+      new_planes.clear();
+      for(int x=x_first; x<=x_last; x++) {
+        int & slot_x = plane_x[(x - min_vec[0]) % num_planes];
+        if (slot_x != x) new_planes.push_back(x);
+        slot_x = x;
+      }
+
+      if (!new_planes.empty()) {
+        parallelEdtForChunks(0, new_planes.size() - 1, [&](int begin, int end) {
+          std::vector<T> scratch(_N * _N);
+          for(int i=begin; i<end; i++) compute_plane(new_planes[i], plane_at(new_planes[i]), scratch.data());
+        });
+      }
+
+      parallelEdtForChunks(core_min[1], core_max[1], [&](int y_begin, int y_end) {
+
+        // [x - x_first][z - core_min] rows of one y
+        std::vector<T> rows(n * _N), rows_res(n * _N);
+        _Scalar dist[_N];
+
+        for(int y=y_begin; y<y_end; y++) {
+          const int row_offset = (y - min_vec[1]) * _N + core_min[2] - min_vec[2];
+
+          for(int k=0; k<n; k++) {
+            const T * row = plane_at(x_first + k) + row_offset;
+            std::copy(row, row + nz, rows.begin() + k * _N);
+          }
+
+          transform_rows(rows.data(), rows_res.data(), n, nz, window, x_begin - x_first, x_end - x_first + 1);
+
+          for(int x=x_begin; x<=x_end; x++) {
+            const T * res = rows_res.data() + (x - x_first) * _N;
+
+            for(int i=0; i<nz; i++) {
+              dist[i] = std::min(resolution_ * std::sqrt(_Scalar(res[i])), truncation_distance_);
+            }
+
+            if (inside) {
+              for(int i=0; i<nz; i++) {
+                if (res[i] != 0) distance_buffer_.at(offset + Vector3i(x, y, core_min[2] + i)) = encodeDistance(-dist[i]);
+              }
+            } else {
+              for(int i=0; i<nz; i++) {
+                distance_buffer_.at(offset + Vector3i(x, y, core_min[2] + i)) = encodeDistance(dist[i]);
+              }
+            }
+          }
+        }
+      });
     }
+  }
 
+  // Squared distance transform across the n rows of m values in rows,
+  // rows start _N values apart. Only the rows [res_begin, res_end) of res
+  // are needed. As in edt_rows, narrow windows take the minimum over the
+  // rows up to window away and wide ones the lower envelope per column.
+  static void transform_rows(const int32_t * rows, int32_t * res, int n, int m, int window,
+                             int res_begin, int res_end) {
+    edt_rows(rows, res, n, m, window, res_begin, res_end);
+  }
 
-    for(int y=min_vec[1]; y<=max_vec[1]; y++) {
-      for(int z=min_vec[2]; z<=max_vec[2]; z++) {
-        fill_edt([&](int x) {return tmp_buffer2_.at(Vector3i(x,y,z));},
-                 [&](int x, _Scalar val) { distance_buffer_.at(offset + Vector3i(x,y,z)) = std::min(resolution_ * std::sqrt(val), truncation_distance_);},
-                 min_vec[0], max_vec[0]);
+  void transform_rows(const _Scalar * rows, _Scalar * res, int n, int m, int window,
+                      int res_begin, int res_end) {
+
+    if (window <= _EDT_MAX_WINDOW) {
+      for(int j=res_begin; j<res_end; j++) {
+        _Scalar * res_row = res + j * _N;
+        std::copy(rows + j * _N, rows + j * _N + m, res_row);
+
+        const int d_min = std::max(-window, -j);
+        const int d_max = std::min(window, n - 1 - j);
+
+        for(int d=d_min; d<=d_max; d++) {
+          const _Scalar * row = rows + (j + d) * _N;
+          const _Scalar d2 = d * d;
+          for(int i=0; i<m; i++) res_row[i] = std::min(res_row[i], row[i] + d2);
+        }
       }
+      return;
     }
 
+    for(int i=0; i<m; i++) {
+      fill_edt([&](int j) {return rows[j * _N + i];},
+               [&](int j, _Scalar val) {res[j * _N + i] = val;},
+               0, n - 1);
+    }
+  }
 
-    occupancy_buffer_.clearUpdatedMinMax();
+  // Collects the boxes, in volume coordinates, that need a new distance
+  // transform: all voxels within band voxels of a dirty brick. Bricks
+  // within the band of a dirty brick are grouped into few boxes by
+  // splitting at empty slices of bricks, so changes at opposite faces do
+  // not cover the whole volume. Every box is the bounding box of its dirty
+  // bricks extended by the band.
+  void getEdtBoxes(const Vector3i & offset, std::vector<std::pair<Vector3i, Vector3i>> & boxes) {
+
+    static const int B = OccupancyBuffer::_BRICK_N;
+    const int band = getEdtBand();
+
+    Vector3i first_brick, num_bricks;
+    std::vector<uint8_t> dirty, region;
+    getDirtyRegion(offset, first_brick, num_bricks, dirty, region);
+
+    auto at = [&](const Vector3i & b) -> uint8_t & {
+      return region[(b[0] * num_bricks[1] + b[1]) * num_bricks[2] + b[2]];
+    };
+
+    splitEdtRegion(at, Vector3i(0, 0, 0), num_bricks - Vector3i(1, 1, 1), [&](const Vector3i & lo, const Vector3i & hi) {
+      Vector3i dirty_min = hi, dirty_max = lo;
+      Vector3i b;
+      for(b[0]=lo[0]; b[0]<=hi[0]; b[0]++) {
+        for(b[1]=lo[1]; b[1]<=hi[1]; b[1]++) {
+          for(b[2]=lo[2]; b[2]<=hi[2]; b[2]++) {
+            if (!dirty[(b[0] * num_bricks[1] + b[1]) * num_bricks[2] + b[2]]) continue;
+            dirty_min = dirty_min.array().min(b.array());
+            dirty_max = dirty_max.array().max(b.array());
+          }
+        }
+      }
+
+      Vector3i core_min, core_max;
+      for(int axis=0; axis<3; axis++) {
+        core_min[axis] = std::max(0, (first_brick[axis] + dirty_min[axis]) * B - offset[axis] - band);
+        core_max[axis] = std::min(_N-1, (first_brick[axis] + dirty_max[axis] + 1) * B - 1 - offset[axis] + band);
+      }
+      boxes.push_back(std::make_pair(core_min, core_max));
+    });
+  }
+
+  // Grid of the bricks that overlap the volume, starting at first_brick.
+  // There is one more than _NUM_BRICKS per axis if the volume is not
+  // aligned to the bricks. dirty holds the dirty bricks and region the
+  // bricks within the band of a dirty brick.
+  void getDirtyRegion(const Vector3i & offset, Vector3i & first_brick, Vector3i & num_bricks,
+                      std::vector<uint8_t> & dirty, std::vector<uint8_t> & region) {
+
+    static const int B = OccupancyBuffer::_BRICK_N;
+
+    first_brick = OccupancyBuffer::getBrick(offset);
+    const Vector3i last_voxel = offset.array() + (_N-1);
+    num_bricks = OccupancyBuffer::getBrick(last_voxel) - first_brick + Vector3i(1, 1, 1);
+
+    region.assign(num_bricks.prod(), 0);
+    auto at = [&](const Vector3i & b) -> uint8_t & {
+      return region[(b[0] * num_bricks[1] + b[1]) * num_bricks[2] + b[2]];
+    };
+
+    Vector3i b;
+    for(b[0]=0; b[0]<num_bricks[0]; b[0]++) {
+      for(b[1]=0; b[1]<num_bricks[1]; b[1]++) {
+        for(b[2]=0; b[2]<num_bricks[2]; b[2]++) {
+          at(b) = occupancy_buffer_.isBrickDirty(first_brick + b);
+        }
+      }
+    }
 
+    dirty = region;
+
+    // Dilate by the band one axis at a time
+    const int band_bricks = (getEdtBand() + B - 1) / B;
+
+    for(int axis=0; axis<3; axis++) {
+      std::vector<uint8_t> dilated(region.size(), 0);
+      auto dilated_at = [&](const Vector3i & b) -> uint8_t & {
+        return dilated[(b[0] * num_bricks[1] + b[1]) * num_bricks[2] + b[2]];
+      };
+
+      for(b[0]=0; b[0]<num_bricks[0]; b[0]++) {
+        for(b[1]=0; b[1]<num_bricks[1]; b[1]++) {
+          for(b[2]=0; b[2]<num_bricks[2]; b[2]++) {
+            if (!at(b)) continue;
+            Vector3i n = b;
+            for(n[axis]=std::max(0, b[axis] - band_bricks);
+                n[axis]<=std::min(num_bricks[axis] - 1, b[axis] + band_bricks); n[axis]++) {
+              dilated_at(n) = 1;
+            }
+          }
+        }
+      }
+
+      region.swap(dilated);
+    }
+  }
+
+  // Shrinks [lo, hi] to the set bricks of the region and splits it at
+  // slices without set bricks, recursively. Calls func(lo, hi) for every
+  // box that cannot be split further.
+  template<typename F_at, typename F>
+  static void splitEdtRegion(F_at & at, Vector3i lo, Vector3i hi, F func) {
+
+    Vector3i set_min = hi, set_max = lo;
+    bool any = false;
+
+    Vector3i b;
+    for(b[0]=lo[0]; b[0]<=hi[0]; b[0]++) {
+      for(b[1]=lo[1]; b[1]<=hi[1]; b[1]++) {
+        for(b[2]=lo[2]; b[2]<=hi[2]; b[2]++) {
+          if (!at(b)) continue;
+          set_min = set_min.array().min(b.array());
+          set_max = set_max.array().max(b.array());
+          any = true;
+        }
+      }
+    }
+
+    if (!any) return;
+
+    lo = set_min;
+    hi = set_max;
+
+    for(int axis=0; axis<3; axis++) {
+      for(int gap=lo[axis]+1; gap<hi[axis]; gap++) {
+        Vector3i slice_lo = lo, slice_hi = hi;
+        slice_lo[axis] = slice_hi[axis] = gap;
+
+        bool empty = true;
+        for(b[0]=slice_lo[0]; b[0]<=slice_hi[0] && empty; b[0]++) {
+          for(b[1]=slice_lo[1]; b[1]<=slice_hi[1] && empty; b[1]++) {
+            for(b[2]=slice_lo[2]; b[2]<=slice_hi[2] && empty; b[2]++) {
+              empty = !at(b);
+            }
+          }
+        }
+
+        if (empty) {
+          Vector3i first_hi = hi, second_lo = lo;
+          first_hi[axis] = gap - 1;
+          second_lo[axis] = gap + 1;
+          splitEdtRegion(at, lo, first_hi, func);
+          splitEdtRegion(at, second_lo, hi, func);
+          return;
+        }
+      }
+    }
+
+    func(lo, hi);
+  }
+
+  void setEdtNumThreads(int num_threads) {
+    if (num_threads > 1) {
+      if (!edt_thread_pool_ || edt_thread_pool_->size() != num_threads) {
+        edt_thread_pool_.reset(new ThreadPool(num_threads));
+      }
+    } else {
+      edt_thread_pool_.reset();
+    }
+  }
+
+  // Calls func(begin, end) for chunks of [first, last], one chunk per EDT
+  // thread. end is exclusive.
+  template<typename F>
+  void parallelEdtForChunks(int first, int last, F func) {
+    if (edt_thread_pool_) {
+      edt_thread_pool_->parallelFor(first, last + 1, [&](int, int begin, int end) {
+        func(begin, end);
+      });
+    } else {
+      func(first, last + 1);
+    }
+  }
+
+  // Calls func(i) for all i in [first, last], split between the EDT threads.
+  template<typename F>
+  void parallelEdtFor(int first, int last, F func) {
+    parallelEdtForChunks(first, last, [&](int begin, int end) {
+      for (int i = begin; i < end; i++) func(i);
+    });
+  }
+
+  // Squared distance transform across the n rows of a plane, every row
+  // has m values and starts _N values after the previous one. If the
+  // window is narrow, every row is the minimum of the rows up to window
+  // away plus the squared row distance, computed along the rows so the
+  // compiler vectorizes it. Results that need rows farther away are above
+  // the truncation distance. Wide windows use the exact lower envelope
+  // per column instead. Only the rows [res_begin, res_end) of res are
+  // needed, res_end -1 stands for n.
+  static void edt_rows(const int32_t * plane, int32_t * res, int n, int m, int window,
+                       int res_begin = 0, int res_end = -1) {
+
+    const int32_t inf = _EDT_INF;
+
+    if (window <= _EDT_MAX_WINDOW) {
+      for(int j=res_begin; j<(res_end < 0 ? n : res_end); j++) {
+        int32_t * res_row = res + j * _N;
+        std::copy(plane + j * _N, plane + j * _N + m, res_row);
+
+        const int d_min = std::max(-window, -j);
+        const int d_max = std::min(window, n - 1 - j);
+
+        for(int d=d_min; d<=d_max; d++) {
+          const int32_t * row = plane + (j + d) * _N;
+          const int32_t d2 = d * d;
+          for(int i=0; i<m; i++) res_row[i] = std::min(res_row[i], row[i] + d2);
+        }
+
+        for(int i=0; i<m; i++) res_row[i] = std::min(res_row[i], inf);
+      }
+
+    } else {
+      // Zeroed so GCC can see that lower_envelope_edt only reads [0, n)
+      int32_t line[_N] = {}, line_res[_N];
+
+      for(int i=0; i<m; i++) {
+        for(int j=0; j<n; j++) line[j] = plane[j * _N + i];
+        lower_envelope_edt(line, line_res, n);
+        for(int j=0; j<n; j++) res[j * _N + i] = line_res[j];
+      }
+    }
+  }
+
+  // Trilinear interpolation of a cell in voxel units, see setGradientField:
+  // distance, gradient along x, y, z and the mixed terms xy, xz, yz, xyz.
+  // Stored as float to halve the memory with a double _Scalar.
+  struct GradientCell {
+    float coeff[8];
+  };
+
+  // Closest obstacle of a voxel in the incremental distance transform.
+  // dist2 is the squared distance in voxels, _EDT_INF if no obstacle is
+  // within the truncation distance. raise is set while the voxel waits for
+  // its neighbours to be checked after its obstacle disappeared.
+  struct EsdfVoxel {
+    Vector3i obstacle;
+    int32_t dist2;
+    bool raise;
+  };
+
+  // Queues a voxel. Voxels are processed in the order of increasing key,
+  // which is a squared distance in voxels.
+  inline void pushEsdf(int32_t key, const Vector3i & idx) {
+    esdf_buckets_[key].push_back(idx);
+    if (key < esdf_min_bucket_) esdf_min_bucket_ = key;
+  }
+
+  inline void setEsdfDistance(const Vector3i & idx, EsdfVoxel & v, const Vector3i & obstacle, int32_t dist2) {
+    v.obstacle = obstacle;
+    v.dist2 = dist2;
+    distance_buffer_.at(idx) = encodeDistance(std::min(resolution_ * std::sqrt(_Scalar(dist2)), truncation_distance_));
+    if (gradient_buffer_) gradient_bricks_.set(OccupancyBuffer::brickSlot(OccupancyBuffer::getBrick(idx)));
+  }
+
+  inline void clearEsdfVoxel(const Vector3i & idx, EsdfVoxel & v) {
+    v.dist2 = _EDT_INF;
+    distance_buffer_.at(idx) = encodeDistance(truncation_distance_);
+    if (gradient_buffer_) gradient_bricks_.set(OccupancyBuffer::brickSlot(OccupancyBuffer::getBrick(idx)));
+  }
+
+  inline bool isEsdfObstacle(const Vector3i & idx) {
+    return distance_buffer_.insideVolume(idx) && occupancy_buffer_.isOccupied(idx);
+  }
+
+  void setEsdfObstacle(const Vector3i & idx) {
+    EsdfVoxel & v = esdf_buffer_->at(idx);
+    setEsdfDistance(idx, v, idx, 0);
+    v.raise = false;
+    pushEsdf(0, idx);
+  }
+
+  void removeEsdfObstacle(const Vector3i & idx) {
+    EsdfVoxel & v = esdf_buffer_->at(idx);
+    clearEsdfVoxel(idx, v);
+    v.raise = true;
+    pushEsdf(0, idx);
+  }
+
+  // After a move, voxels near the faces along the moved axes may point to
+  // obstacles that left the volume, and voxels that entered the volume
+  // have no obstacle yet. Both are at most one truncation window away from
+  // a face, so only these slabs are queued.
+  void queueEsdfFaces(const Vector3i & direction) {
+    if ((direction.array().abs() >= _N).any()) return;
+
+    Vector3i offset;
+    distance_buffer_.getOffset(offset);
+
+    const int window = std::ceil(truncation_distance_ / resolution_) + 1;
+
+    for(int axis=0; axis<3; axis++) {
+      if (direction[axis] == 0) continue;
+
+      const int width = std::min(_N, std::abs(direction[axis]) + window + 1);
+
+      for(int side=0; side<2; side++) {
+        Vector3i min(0, 0, 0), max(_N, _N, _N);
+        min[axis] = side ? _N - width : 0;
+        max[axis] = side ? _N : width;
+
+        for(int x=min[0]; x<max[0]; x++) {
+          for(int y=min[1]; y<max[1]; y++) {
+            for(int z=min[2]; z<max[2]; z++) {
+              const Vector3i idx = offset + Vector3i(x, y, z);
+              EsdfVoxel & v = esdf_buffer_->at(idx);
+
+              if (v.dist2 >= _EDT_INF || v.raise) continue;
+
+              if (isEsdfObstacle(v.obstacle)) {
+                pushEsdf(v.dist2, idx);
+              } else {
+                clearEsdfVoxel(idx, v);
+                v.raise = true;
+                pushEsdf(0, idx);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // Applies the occupancy changes since the last update and propagates
+  // the wavefronts until the queue is empty.
+  void update_esdf() {
+
+    for (const Vector3i & idx : occupancy_buffer_.getChangedVoxels()) {
+      if (!distance_buffer_.insideVolume(idx)) continue;
+
+      const bool occupied = occupancy_buffer_.isOccupied(idx);
+      const bool obstacle = esdf_buffer_->at(idx).dist2 == 0;
+
+      if (occupied && !obstacle) {
+        setEsdfObstacle(idx);
+      } else if (!occupied && obstacle) {
+        removeEsdfObstacle(idx);
+      }
+    }
+
+    occupancy_buffer_.clearChangedVoxels();
+
+    const int32_t max_dist2 = esdf_buckets_.size() - 1;
+
+    while (esdf_min_bucket_ <= max_dist2) {
+      std::vector<Vector3i> & bucket = esdf_buckets_[esdf_min_bucket_];
+      if (bucket.empty()) {
+        esdf_min_bucket_++;
+        continue;
+      }
+
+      const int32_t key = esdf_min_bucket_;
+      const Vector3i idx = bucket.back();
+      bucket.pop_back();
+
+      if (!distance_buffer_.insideVolume(idx)) continue;
+
+      EsdfVoxel & v = esdf_buffer_->at(idx);
+
+      if (v.raise) {
+        // Neighbours that point to obstacles which are gone are cleared
+        // and raised as well, the others lower the cleared voxels again.
+        forEachEsdfNeighbor(idx, [&](const Vector3i & n, EsdfVoxel & nv) {
+          if (nv.dist2 >= _EDT_INF || nv.raise) return;
+
+          const int32_t n_key = nv.dist2;
+          if (!isEsdfObstacle(nv.obstacle)) {
+            clearEsdfVoxel(n, nv);
+            nv.raise = true;
+          }
+          pushEsdf(n_key, n);
+        });
+
+        v.raise = false;
+
+      } else if (v.dist2 == key && isEsdfObstacle(v.obstacle)) {
+        forEachEsdfNeighbor(idx, [&](const Vector3i & n, EsdfVoxel & nv) {
+          if (nv.raise) return;
+
+          const int32_t dist2 = (n - v.obstacle).squaredNorm();
+          if (dist2 < nv.dist2 && dist2 <= max_dist2) {
+            setEsdfDistance(n, nv, v.obstacle, dist2);
+            pushEsdf(dist2, n);
+          }
+        });
+      }
+    }
+  }
+
+  // Calls func(idx, voxel) for the 26 neighbours of idx inside the volume.
+  template<typename F>
+  inline void forEachEsdfNeighbor(const Vector3i & idx, F func) {
+    static const int neighbors[26][3] = {
+      {-1,-1,-1}, {-1,-1, 0}, {-1,-1, 1}, {-1, 0,-1}, {-1, 0, 0}, {-1, 0, 1}, {-1, 1,-1}, {-1, 1, 0}, {-1, 1, 1},
+      { 0,-1,-1}, { 0,-1, 0}, { 0,-1, 1}, { 0, 0,-1},              { 0, 0, 1}, { 0, 1,-1}, { 0, 1, 0}, { 0, 1, 1},
+      { 1,-1,-1}, { 1,-1, 0}, { 1,-1, 1}, { 1, 0,-1}, { 1, 0, 0}, { 1, 0, 1}, { 1, 1,-1}, { 1, 1, 0}, { 1, 1, 1}};
+
+    Vector3i offset;
+    distance_buffer_.getOffset(offset);
+    const Vector3i local = idx - offset;
+
+    // Neighbours of voxels away from the faces are always inside
+    const bool interior = (local.array() > 0).all() && (local.array() < _N - 1).all();
+
+    for(int i=0; i<26; i++) {
+      const Vector3i n = idx + Vector3i(neighbors[i][0], neighbors[i][1], neighbors[i][2]);
+      if (interior || distance_buffer_.insideVolume(n)) func(n, esdf_buffer_->at(n));
+    }
+  }
+
+  // Floor of n / d for d > 0
+  static inline int32_t floor_div(int32_t n, int32_t d) {
+    return n >= 0 ? n / d : -((d - 1 - n) / d);
+  }
+
+  // 1D squared distance transform of f[0..n) in integer arithmetic, with
+  // the lower envelope scan of Meijster et al. Values of at least
+  // _EDT_INF mean no obstacle, results are clamped to _EDT_INF.
+  static void lower_envelope_edt(const int32_t * f, int32_t * res, int n) {
+
+    const int32_t inf = _EDT_INF;
+
+    int s[_N], t[_N];
+    int q = 0;
+    s[0] = 0;
+    t[0] = 0;
+
+    for(int u = 1; u < n; u++) {
+      while(q >= 0 && (t[q] - s[q]) * (t[q] - s[q]) + f[s[q]] > (t[q] - u) * (t[q] - u) + f[u]) q--;
+
+      if(q < 0) {
+        q = 0;
+        s[0] = u;
+      } else {
+        const int w = 1 + floor_div(u * u - s[q] * s[q] + f[u] - f[s[q]], 2 * (u - s[q]));
+        if(w < n) {
+          q++;
+          s[q] = u;
+          t[q] = w;
+        }
+      }
+    }
+
+    for(int u = n - 1; u >= 0; u--) {
+      res[u] = std::min((u - s[q]) * (u - s[q]) + f[s[q]], inf);
+      if(u == t[q]) q--;
+    }
   }
 
   template <typename F_get_val, typename F_set_val>
@@ -352,11 +1837,36 @@ class EuclideanDistanceRingBuffer {
   _Scalar resolution_;
   _Scalar truncation_distance_;
 
-  RaycastRingBuffer <_POW, _Datatype, _Scalar, _Flag> occupancy_buffer_;
+  // stored distance per meter
+  _Scalar distance_scale_;
+
+  RaycastRingBuffer <_POW, _Datatype, _Scalar, _Flag, _Layout, _Interleaved> occupancy_buffer_;
+
+  RingBufferBase <_POW, _Distance, _Scalar, _Layout> distance_buffer_;
+
+  bool distance_collision_check_;
+  bool vectorized_edt_;
+  bool lazy_edt_;
+  bool signed_distance_;
+  bool tricubic_interpolation_;
+  std::mutex distance_mutex_;
+
+  // bricks whose distances are out of date in the lazy mode, see
+  // OccupancyBuffer::brickSlot
+  std::bitset<OccupancyBuffer::_NUM_BRICKS * OccupancyBuffer::_NUM_BRICKS * OccupancyBuffer::_NUM_BRICKS> stale_bricks_;
+
+  // workers for the distance transform
+  std::unique_ptr<ThreadPool> edt_thread_pool_;
 
-  RingBufferBase <_POW, _Scalar, _Scalar> distance_buffer_;
+  // state of the incremental distance transform, only allocated if enabled
+  std::unique_ptr<RingBufferBase<_POW, EsdfVoxel, _Scalar, _Layout>> esdf_buffer_;
+  std::vector<std::vector<Vector3i>> esdf_buckets_;
+  int32_t esdf_min_bucket_;
 
-  RingBufferBase <_POW, _Scalar, _Scalar> tmp_buffer1_, tmp_buffer2_;
+  // interpolation cells, only allocated if enabled, and the bricks whose
+  // cells the incremental transform has to refresh
+  std::unique_ptr<RingBufferBase<_POW, GradientCell, _Scalar, _Layout>> gradient_buffer_;
+  std::bitset<OccupancyBuffer::_NUM_BRICKS * OccupancyBuffer::_NUM_BRICKS * OccupancyBuffer::_NUM_BRICKS> gradient_bricks_;
 
 };
 
@@ -26,12 +26,144 @@
 #define EWOK_RING_BUFFER_INCLUDE_EWOK_RAYCAST_RING_BUFFER_H_
 
 #include <ewok/ring_buffer_base.h>
+#include <ewok/thread_pool.h>
 
+#include <cmath>
 #include <vector>
+#include <memory>
+#include <bitset>
 
 namespace ewok {
 
-template<int _POW, typename _Datatype = int16_t, typename _Scalar = float, typename _Flag = uint8_t>
+// Voxel storage of RaycastRingBuffer. The storage is the ring buffer that
+// defines the volume geometry and gives access to the occupancy and the
+// flags of every voxel.
+template<int _POW, typename _Datatype, typename _Scalar, typename _Flag,
+         template<int> class _Layout, bool _Interleaved>
+class OccupancyStorage;
+
+// Occupancy and flags in two separate buffers.
+template<int _POW, typename _Datatype, typename _Scalar, typename _Flag,
+         template<int> class _Layout>
+class OccupancyStorage<_POW, _Datatype, _Scalar, _Flag, _Layout, false>
+    : public RingBufferBase<_POW, _Datatype, _Scalar, _Layout> {
+ public:
+
+  typedef RingBufferBase<_POW, _Datatype, _Scalar, _Layout> Base;
+  typedef typename Base::Vector3i Vector3i;
+  typedef typename Base::Vector4 Vector4;
+  typedef _Datatype Element;
+
+  explicit OccupancyStorage(const _Scalar & resolution)
+      : Base(resolution, _Datatype(0)), flag_buffer_(resolution, _Flag(0)) {
+  }
+
+  // Flags of the voxels that enter the volume
+  void setEmptyFlag(const _Flag & f) {
+    flag_buffer_.setEmptyElement(f);
+  }
+
+  inline _Datatype & occupancy(const Vector3i & idx) {
+    return this->at(idx);
+  }
+
+  inline _Flag & flag(const Vector3i & idx) {
+    return flag_buffer_.at(idx);
+  }
+
+  static inline const _Datatype & occupancyOf(const Element & e) {
+    return e;
+  }
+
+  virtual void setOffset(const Vector3i & offset) {
+    Base::setOffset(offset);
+    flag_buffer_.setOffset(offset);
+  }
+
+  virtual void moveVolume(const Vector3i & direction) {
+    Base::moveVolume(direction);
+    flag_buffer_.moveVolume(direction);
+  }
+
+  // Calls func(occupancy) for all voxels of the slab.
+  template<typename F>
+  void forEachOccupancyInSlab(int axis, int first_slice, int num_slices, F func) {
+    this->forEachSlabRange(axis, first_slice, num_slices,
+                           [&](const _Datatype * begin, const _Datatype * end) {
+      for (const _Datatype * d = begin; d != end; ++d) func(*d);
+    });
+  }
+
+  template<typename F>
+  void getMarkerFlagHelper(visualization_msgs::Marker &m, const std::string &ns, int id,
+                           const Vector4 &color, F func) {
+    flag_buffer_.getMarkerHelper(m, ns, id, color, func);
+  }
+
+ protected:
+
+  RingBufferBase<_POW, _Flag, _Scalar, _Layout> flag_buffer_;
+};
+
+// Occupancy and flags of a voxel stored next to each other, so an update
+// touches one cache line and computes the index once. With int16_t
+// occupancy and uint8_t flags a voxel takes 4 bytes.
+template<typename _Datatype, typename _Flag>
+struct OccupancyFlagVoxel {
+  _Datatype occupancy;
+  _Flag flag;
+};
+
+template<int _POW, typename _Datatype, typename _Scalar, typename _Flag,
+         template<int> class _Layout>
+class OccupancyStorage<_POW, _Datatype, _Scalar, _Flag, _Layout, true>
+    : public RingBufferBase<_POW, OccupancyFlagVoxel<_Datatype, _Flag>, _Scalar, _Layout> {
+ public:
+
+  typedef OccupancyFlagVoxel<_Datatype, _Flag> Element;
+  typedef RingBufferBase<_POW, Element, _Scalar, _Layout> Base;
+  typedef typename Base::Vector3i Vector3i;
+  typedef typename Base::Vector4 Vector4;
+
+  explicit OccupancyStorage(const _Scalar & resolution)
+      : Base(resolution, Element{_Datatype(0), _Flag(0)}) {
+  }
+
+  void setEmptyFlag(const _Flag & f) {
+    this->setEmptyElement(Element{_Datatype(0), f});
+  }
+
+  inline _Datatype & occupancy(const Vector3i & idx) {
+    return this->at(idx).occupancy;
+  }
+
+  inline _Flag & flag(const Vector3i & idx) {
+    return this->at(idx).flag;
+  }
+
+  static inline const _Datatype & occupancyOf(const Element & e) {
+    return e.occupancy;
+  }
+
+  template<typename F>
+  void forEachOccupancyInSlab(int axis, int first_slice, int num_slices, F func) {
+    this->forEachSlabRange(axis, first_slice, num_slices,
+                           [&](const Element * begin, const Element * end) {
+      for (const Element * e = begin; e != end; ++e) func(e->occupancy);
+    });
+  }
+
+  template<typename F>
+  void getMarkerFlagHelper(visualization_msgs::Marker &m, const std::string &ns, int id,
+                           const Vector4 &color, F func) {
+    this->getMarkerHelper(m, ns, id, color, [&](const Element & e) { return func(e.flag); });
+  }
+};
+
+// If _Interleaved is true, occupancy and flags are stored in a single
+// buffer of OccupancyFlagVoxel instead of two separate buffers.
+template<int _POW, typename _Datatype = int16_t, typename _Scalar = float, typename _Flag = uint8_t,
+         template<int> class _Layout = LinearLayout, bool _Interleaved = false>
 class RaycastRingBuffer {
  public:
 
@@ -45,6 +177,12 @@ class RaycastRingBuffer {
 
   static const _Flag insertion_flags = (occupied_flag | free_flag | free_ray_flag);
 
+  // Changes are tracked per brick of _BRICK_N^3 voxels. Bricks are aligned
+  // to the world grid and wrap around like the voxels, _NUM_BRICKS per axis.
+  static const int _BRICK_POW = (_POW < 3 ? _POW : 3);
+  static const int _BRICK_N = (1 << _BRICK_POW);
+  static const int _NUM_BRICKS = _N / _BRICK_N;
+
 
   // Definition of hit/miss and values for the datatype
   static constexpr double min_val = -2;
@@ -66,44 +204,79 @@ class RaycastRingBuffer {
   typedef Eigen::Matrix<_Scalar, 4, 1> Vector4;
   typedef Eigen::Matrix<_Scalar, 3, 1> Vector3;
   typedef Eigen::Matrix<int, 3, 1> Vector3i;
+  typedef Eigen::Matrix<_Scalar, 3, 3> Matrix3;
+  typedef Eigen::Matrix<_Scalar, 4, 4> Matrix4;
   typedef std::vector <Vector4, Eigen::aligned_allocator<Vector4>> PointCloud;
 
+  typedef OccupancyStorage<_POW, _Datatype, _Scalar, _Flag, _Layout, _Interleaved> Storage;
+  typedef typename Storage::Element VoxelElement;
+
 
   RaycastRingBuffer(const _Scalar &resolution) :
       resolution_(resolution),
-      occupancy_buffer_(resolution, _Datatype(0)),
-      flag_buffer_(resolution, _Flag(0)) {
+      voxel_buffer_(resolution),
+      num_occupied_(0), num_free_(0),
+      record_changed_voxels_(false) {
 
-    flag_buffer_.setEmptyElement(updated_flag);
+    voxel_buffer_.setEmptyFlag(updated_flag);
     clearUpdatedMinMax();
+
+    // Nothing is known about the volume, so all of it needs a first update
+    dirty_bricks_.set();
+  }
+
+  // Number of threads used for ray casting in insertPointCloud.
+  // The result does not depend on the number of threads.
+  void setNumThreads(int num_threads) {
+    if (num_threads > 1) {
+      thread_pool_.reset(new ThreadPool(num_threads));
+      thread_touched_voxels_.resize(num_threads);
+    } else {
+      thread_pool_.reset();
+      thread_touched_voxels_.clear();
+    }
+  }
+
+  inline int getNumThreads() {
+    return thread_pool_ ? thread_pool_->size() : 1;
   }
 
   inline bool isOccupied(const Vector3i & idx) {
-    return isOccupied(occupancy_buffer_.at(idx));
+    return isOccupied(voxel_buffer_.occupancy(idx));
   }
 
   inline bool isFree(const Vector3i & idx) {
-    return isFree(occupancy_buffer_.at(idx));
+    return isFree(voxel_buffer_.occupancy(idx));
   }
 
   inline bool isUpdated(const Vector3i & idx) {
-    return flag_buffer_.at(idx) & updated_flag;
+    return voxel_buffer_.flag(idx) & updated_flag;
   }
 
   inline bool clearUpdated(const Vector3i & idx) {
-    return flag_buffer_.at(idx) &= ~updated_flag;
+    return voxel_buffer_.flag(idx) &= ~updated_flag;
   }
 
   inline bool isPointNear(const Vector3 & point, const _Scalar & rad)
   {
-      return occupancy_buffer_.isPointNear(point, rad, [](const _Datatype & d) { return isOccupied(d);});
+      return isPointNear(point, voxel_buffer_.getNeighborhoodStencil(rad));
+  }
+
+  inline bool isPointNear(const Vector3 & point, const std::vector<Vector3i> & stencil)
+  {
+      return voxel_buffer_.isPointNear(point, stencil, [](const VoxelElement & e) { return isOccupied(Storage::occupancyOf(e));});
+  }
+
+  inline const std::vector<Vector3i> & getNeighborhoodStencil(const _Scalar & rad)
+  {
+      return voxel_buffer_.getNeighborhoodStencil(rad);
   }
 
   inline bool insideVolume(const Vector3 &point)
   {
       Vector3i idx;
-      occupancy_buffer_.getIdx(point, idx);
-      return occupancy_buffer_.insideVolume(idx);
+      voxel_buffer_.getIdx(point, idx);
+      return voxel_buffer_.insideVolume(idx);
   }
 
   void getUpdatedMinMax(Vector3i & updated_min, Vector3i & updated_max) {
@@ -111,246 +284,386 @@ class RaycastRingBuffer {
     updated_max = updated_max_;
   }
 
+  inline bool hasUpdatedRegion() {
+    return dirty_bricks_.any();
+  }
+
+  // A brick is dirty if the occupied state of one of its voxels changed or
+  // if it entered the volume since the last clearUpdatedMinMax. Bricks
+  // next to a face the volume moved away from are dirty as well. brick is
+  // the index of the voxel divided by _BRICK_N.
+  inline bool isBrickDirty(const Vector3i & brick) const {
+    return dirty_bricks_[brickSlot(brick)];
+  }
+
+  static inline Vector3i getBrick(const Vector3i & idx) {
+    return Vector3i(idx[0] >> _BRICK_POW, idx[1] >> _BRICK_POW, idx[2] >> _BRICK_POW);
+  }
+
+  // Position of a brick in a bitmap of _NUM_BRICKS^3 bricks
+  static inline int brickSlot(const Vector3i & brick) {
+    static const int mask = _NUM_BRICKS - 1;
+    return ((brick[0] & mask) * _NUM_BRICKS + (brick[1] & mask)) * _NUM_BRICKS + (brick[2] & mask);
+  }
+
+  // If enabled, voxels whose occupied state flips during an insertion are
+  // recorded until clearChangedVoxels is called.
+  void setRecordChangedVoxels(bool enable) {
+    record_changed_voxels_ = enable;
+    changed_voxels_.clear();
+  }
+
+  inline const std::vector<Vector3i> & getChangedVoxels() const {
+    return changed_voxels_;
+  }
+
+  void clearChangedVoxels() {
+    changed_voxels_.clear();
+  }
+
   void clearUpdatedMinMax() {
     Vector3i offset;
-    occupancy_buffer_.getOffset(offset);
+    voxel_buffer_.getOffset(offset);
 
     updated_min_ = offset + Vector3i(_N-1, _N-1, _N-1);
     updated_max_ = offset;
+
+    dirty_bricks_.reset();
   }
 
   void insertPointCloud(const PointCloud &cloud, const Vector3 &origin) {
 
     Vector3i origin_idx;
-    occupancy_buffer_.getIdx(origin, origin_idx);
+    voxel_buffer_.getIdx(origin, origin_idx);
 
-    if (!occupancy_buffer_.insideVolume(
+    if (!voxel_buffer_.insideVolume(
         origin_idx)) {
       //ROS_WARN("Origin outside of volume. Skipping pointcloud.");
       return;
     }
 
-    Vector3i min_idx = origin_idx;
-    Vector3i max_idx = origin_idx;
+    touched_voxels_.clear();
 
-    // Iterate over all points in pointcloud and mark occupied.
-    // If a point is outside the volume - compute closes point in volume
-    // and mark for inserting a free ray
     for (const Vector4 &vec : cloud) {
-      Vector3 v = vec.template head<3>();
-      Vector3i idx;
-      occupancy_buffer_.getIdx(v, idx);
-
-      if (occupancy_buffer_.insideVolume(idx)) {
-        flag_buffer_.at(idx) |= occupied_flag;
-
-      } else {
-        Vector3 p;
-        closestPointInVolume(v, origin, p);
-        occupancy_buffer_.getIdx(p, idx);
-        flag_buffer_.at(idx) |= free_ray_flag;
-      }
-
-      min_idx = min_idx.array().min(idx.array());
-      max_idx = max_idx.array().max(idx.array());
+      markEndpoint(vec.template head<3>(), origin);
     }
 
+    castRaysAndUpdate(origin_idx);
+  }
 
-    // Iterate over all occupied voxels and insert free rays.
-    for (int x = min_idx(0); x <= max_idx(0); ++x) {
-      for (int y = min_idx(1); y <= max_idx(1); ++y) {
-        for (int z = min_idx(2); z <= max_idx(2); ++z) {
-
-          Vector3i idx(x, y, z);
-
-          if (flag_buffer_.at(idx) & (occupied_flag | free_ray_flag)) {
-            insertFreeBresenham3D(idx, origin_idx);
-          }
-        }
-      }
-    }
-
-    // Iterate over all marked voxels and update
-    for (int x = min_idx(0); x <= max_idx(0); ++x) {
-      for (int y = min_idx(1); y <= max_idx(1); ++y) {
-        for (int z = min_idx(2); z <= max_idx(2); ++z) {
-
-          Vector3i idx(x, y, z);
-
-          if (flag_buffer_.at(idx) & occupied_flag) {
-
-            _Datatype & occupancy_data = occupancy_buffer_.at(idx);
-
-            bool was_occupied = isOccupied(occupancy_data);
-            addHit(occupancy_data);
-            bool is_occupied = isOccupied(occupancy_data);
-
-            flag_buffer_.at(idx) &= ~insertion_flags;
-
-            if (was_occupied != is_occupied) {
-              flag_buffer_.at(idx) |= updated_flag;
-
-              updated_min_ = updated_min_.array().min(idx.array());
-              updated_max_ = updated_max_.array().max(idx.array());
-            }
-
-          } else if (flag_buffer_.at(idx) & (free_flag | free_ray_flag)) {
-
-            _Datatype & occupancy_data = occupancy_buffer_.at(idx);
-
-            bool was_occupied = isOccupied(occupancy_data);
-            addMiss(occupancy_data);
-            bool is_occupied =  isOccupied(occupancy_data);
-            flag_buffer_.at(idx) &= ~insertion_flags;
-
-            if (was_occupied != is_occupied) {
-              flag_buffer_.at(idx) |= updated_flag;
+  // Inserts a depth image with depth in meters. Rays are built directly
+  // from every subsample-th pixel without creating a point cloud.
+  // intrinsics are (fx, fy, cx, cy), T_w_c is the camera to world transform.
+  // Non-finite and non-positive depth values are skipped.
+  void insertDepthImage(const float *data, int width, int height,
+                        const Vector4 &intrinsics, const Matrix4 &T_w_c,
+                        int subsample = 1) {
+    insertDepthImageImpl(data, width, height, intrinsics, T_w_c, subsample, _Scalar(1));
+  }
 
-              updated_min_ = updated_min_.array().min(idx.array());
-              updated_max_ = updated_max_.array().max(idx.array());
-            }
-          }
-        }
-      }
-    }
+  // Same for 16 bit depth images, depth in meters is value * depth_scale.
+  // Zero values are skipped.
+  void insertDepthImage(const uint16_t *data, int width, int height,
+                        const Vector4 &intrinsics, const Matrix4 &T_w_c,
+                        int subsample = 1, _Scalar depth_scale = 0.001) {
+    insertDepthImageImpl(data, width, height, intrinsics, T_w_c, subsample, depth_scale);
   }
 
+  // Volume of all voxels that are not occupied. Counters are maintained
+  // incrementally, so this does not scan the buffer.
   void getMapInfo(_Scalar &free_space)
   {
-      _Scalar obs_counter = 0;
-      Vector3i offset_;
       _Scalar cube_volume = pow(resolution_,3);
 
-      occupancy_buffer_.getOffset(offset_);
-
-      for (int x = 0; x < _N; x++) {
-          for (int y = 0; y < _N; y++) {
-              for (int z = 0; z < _N; z++) {
-
-                  Vector3i coord(x, y, z);
-                  coord += offset_;
-
-                  if (isOccupied(coord)) obs_counter++;
-              }
-          }
-      }
-
-      free_space = ((_N*_N*_N)*cube_volume) - (obs_counter*cube_volume);
+      free_space = ((_N*_N*_N) - num_occupied_)*cube_volume;
+  }
 
+  void getVoxelCounts(int &occupied, int &free, int &unknown)
+  {
+      occupied = num_occupied_;
+      free = num_free_;
+      unknown = _N*_N*_N - num_occupied_ - num_free_;
   }
+
   virtual void setOffset(const Vector3i &off) {
-    occupancy_buffer_.setOffset(off);
-    flag_buffer_.setOffset(off);
+    voxel_buffer_.setOffset(off);
   }
 
+  // Moves the volume by direction voxels. Voxels that enter the volume
+  // are unknown, the whole volume is marked as updated because distances
+  // near both the entering and the leaving faces change. Only the bricks
+  // at these faces are marked dirty.
   virtual void moveVolume(const Vector3i &direction) {
-    occupancy_buffer_.moveVolume(direction);
-    flag_buffer_.moveVolume(direction);
 
-    Vector3i offset;
-    occupancy_buffer_.getOffset(offset);
-
-    Vector3i volume_min = offset;
-    Vector3i volume_max = offset.array() + (_N-1);
-
-    for(int i=0; i<3; ++i) {
-      if(direction[i] > 0) {
-        Vector3i min_point = volume_min;
-        Vector3i max_point = volume_max;
+    if ((direction.array().abs() >= _N).any()) {
+      num_occupied_ = 0;
+      num_free_ = 0;
 
-        min_point[i] = volume_max[i];
+      voxel_buffer_.moveVolume(direction);
+      dirty_bricks_.set();
 
-        updated_min_ = updated_min_.array().min(min_point.array());
-        updated_max_ = updated_max_.array().max(min_point.array());
+    } else {
+      // Move one axis at a time and subtract the slab that leaves the
+      // volume before it is cleared.
+      for (int axis = 0; axis < 3; axis++) {
+        const int shift = direction[axis];
+        if (shift == 0) continue;
 
-        updated_min_ = updated_min_.array().min(max_point.array());
-        updated_max_ = updated_max_.array().max(max_point.array());
+        Vector3i offset;
+        voxel_buffer_.getOffset(offset);
 
-      } else {
-        Vector3i min_point = volume_min;
-        Vector3i max_point = volume_max;
+        if (shift > 0) {
+          removeSlabFromCounters(axis, offset[axis], shift);
+        } else {
+          removeSlabFromCounters(axis, offset[axis] + _N + shift, -shift);
+        }
 
-        max_point[i] = volume_min[i];
+        Vector3i step(0, 0, 0);
+        step[axis] = shift;
 
-        updated_min_ = updated_min_.array().min(min_point.array());
-        updated_max_ = updated_max_.array().max(min_point.array());
+        voxel_buffer_.moveVolume(step);
 
-        updated_min_ = updated_min_.array().min(max_point.array());
-        updated_max_ = updated_max_.array().max(max_point.array());
+        // Entering slab and the first slice on the side that was left
+        voxel_buffer_.getOffset(offset);
 
+        if (shift > 0) {
+          markDirtySlab(axis, offset[axis] + _N - shift, shift);
+          markDirtySlab(axis, offset[axis], 1);
+        } else {
+          markDirtySlab(axis, offset[axis], -shift);
+          markDirtySlab(axis, offset[axis] + _N - 1, 1);
+        }
       }
-
     }
 
+    if (direction.array().any()) {
+      Vector3i offset;
+      voxel_buffer_.getOffset(offset);
+
+      updated_min_ = offset;
+      updated_max_ = offset.array() + (_N-1);
+    }
   }
 
   void getMarkerFree(visualization_msgs::Marker & m)  {
-    occupancy_buffer_.getMarkerHelper(m, "ring_buffer_free", 0, Vector4(0, 1, 0, 0.2),
-                    [](const _Datatype & d) { return isFree(d);});
+    voxel_buffer_.getMarkerHelper(m, "ring_buffer_free", 0, Vector4(0, 1, 0, 0.2),
+                    [](const VoxelElement & e) { return isFree(Storage::occupancyOf(e));});
   }
 
   void getMarkerOccupied(visualization_msgs::Marker & m)  {
-    occupancy_buffer_.getMarkerHelper(m, "ring_buffer_occupied", 0, Vector4(1, 0, 0, 0.8),
-                    [](const _Datatype & d) { return isOccupied(d);});
+    voxel_buffer_.getMarkerHelper(m, "ring_buffer_occupied", 0, Vector4(1, 0, 0, 0.8),
+                    [](const VoxelElement & e) { return isOccupied(Storage::occupancyOf(e));});
   }
 
   void getMarkerUpdated(visualization_msgs::Marker & m)  {
-    flag_buffer_.getMarkerHelper(m, "ring_buffer_occupied", 0, Vector4(1, 1, 0, 0.8),
+    voxel_buffer_.getMarkerFlagHelper(m, "ring_buffer_occupied", 0, Vector4(1, 1, 0, 0.8),
                                       [](const _Flag & f) { return (f & updated_flag);});
   }
 
   void getPoint(const Vector3i &idx, Vector3 &point)
   {
-      occupancy_buffer_.getPoint(idx, point);
+      voxel_buffer_.getPoint(idx, point);
   }
 
   void getIdx(const Vector3 &point, Vector3i &idx)
   {
-      return occupancy_buffer_.getIdx(point, idx);
+      return voxel_buffer_.getIdx(point, idx);
   }
 
   void getVolumeMinMax(Vector3 &min_point, Vector3 &max_point)
   {
       Vector3i offset;
-      occupancy_buffer_.getOffset(offset);
+      voxel_buffer_.getOffset(offset);
 
       Vector3i volume_min = offset;
       Vector3i volume_max = offset.array() + (_N-1);
 
-      occupancy_buffer_.getPoint(volume_min, min_point);
-      occupancy_buffer_.getPoint(volume_max, max_point);
+      voxel_buffer_.getPoint(volume_min, min_point);
+      voxel_buffer_.getPoint(volume_max, max_point);
   }
 
   inline Vector3i getVolumeCenter() {
-    return occupancy_buffer_.getVolumeCenter();
+    return voxel_buffer_.getVolumeCenter();
   }
 
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
  protected:
 
-  static inline void addHit(_Datatype & d) {
-    int occ = d;
-    occ += datatype_hit;
-    if(occ > datatype_max) occ = datatype_max;
-    d = occ;
-  }
-
-  static inline void addMiss(_Datatype & d) {
-    int occ = d;
-    occ += datatype_miss;
-    if(occ < datatype_min) occ = datatype_min;
-    d = occ;
+  // Saturating log-odds update. Hit and miss share one branchless code
+  // path, so the compiler can use min/max instructions instead of jumps.
+  static inline void addHitOrMiss(_Datatype & d, bool is_hit) {
+    int occ = int(d) + (is_hit ? int(datatype_hit) : int(datatype_miss));
+    d = std::min(std::max(occ, int(datatype_min)), int(datatype_max));
   }
 
   static inline bool isOccupied(const _Datatype & d) {
     return d > datatype_hit;
   }
 
+  inline void updateCounters(bool was_occupied, bool was_free, const _Datatype & d) {
+    num_occupied_ += int(isOccupied(d)) - int(was_occupied);
+    num_free_ += int(isFree(d)) - int(was_free);
+  }
+
+  void removeSlabFromCounters(int axis, int first_slice, int num_slices) {
+    int occupied = 0, free = 0;
+
+    voxel_buffer_.forEachOccupancyInSlab(axis, first_slice, num_slices,
+                                         [&](const _Datatype & d) {
+      occupied += isOccupied(d);
+      free += isFree(d);
+    });
+
+    num_occupied_ -= occupied;
+    num_free_ -= free;
+  }
+
   static inline bool isFree(const _Datatype & d) {
     return d < datatype_miss;
   }
 
+  // Sets the insertion flag of a voxel and records the voxel the first
+  // time it is touched during the current insertion.
+  inline void markVoxel(const Vector3i &idx, _Flag insertion_flag) {
+    _Flag & flag = voxel_buffer_.flag(idx);
+    if (!(flag & insertion_flags)) touched_voxels_.push_back(idx);
+    flag |= insertion_flag;
+  }
+
+  // Marks a ray endpoint as occupied. If the point is outside the volume,
+  // the closest point in the volume is marked for inserting a free ray.
+  inline void markEndpoint(const Vector3 &point, const Vector3 &origin) {
+    Vector3i idx;
+    voxel_buffer_.getIdx(point, idx);
+
+    if (voxel_buffer_.insideVolume(idx)) {
+      markVoxel(idx, occupied_flag);
+
+    } else {
+      Vector3 p;
+      closestPointInVolume(point, origin, p);
+      voxel_buffer_.getIdx(p, idx);
+      markVoxel(idx, free_ray_flag);
+    }
+  }
+
+  template<typename _DepthT>
+  void insertDepthImageImpl(const _DepthT *data, int width, int height,
+                            const Vector4 &intrinsics, const Matrix4 &T_w_c,
+                            int subsample, _Scalar depth_scale) {
+
+    const Matrix3 R = T_w_c.template topLeftCorner<3, 3>();
+    const Vector3 origin = T_w_c.template topRightCorner<3, 1>();
+
+    Vector3i origin_idx;
+    voxel_buffer_.getIdx(origin, origin_idx);
+
+    if (!voxel_buffer_.insideVolume(origin_idx)) return;
+
+    touched_voxels_.clear();
+
+    if (subsample < 1) subsample = 1;
+
+    const _Scalar fx = intrinsics[0], fy = intrinsics[1];
+    const _Scalar cx = intrinsics[2], cy = intrinsics[3];
+
+    // Ray direction of pixel (u, v) in world frame with unit depth is
+    // R.col(0) * (u - cx) / fx + R.col(1) * (v - cy) / fy + R.col(2).
+    for (int v = 0; v < height; v += subsample) {
+      const Vector3 row_dir = R.col(1) * ((v - cy) / fy) + R.col(2);
+      const _DepthT *row = data + v * width;
+
+      for (int u = 0; u < width; u += subsample) {
+        const _Scalar depth = row[u] * depth_scale;
+        if (!(depth > 0) || !std::isfinite(depth)) continue;
+
+        const Vector3 dir = row_dir + R.col(0) * ((u - cx) / fx);
+        markEndpoint(origin + depth * dir, origin);
+      }
+    }
+
+    castRaysAndUpdate(origin_idx);
+  }
+
+  // Inserts free rays from all endpoints in touched_voxels_ to the origin
+  // and applies hits and misses to all touched voxels.
+  void castRaysAndUpdate(const Vector3i &origin_idx) {
+
+    // All voxels in the list so far are ray endpoints. Insert free rays,
+    // which append the voxels they pass through to the list.
+    const size_t num_endpoints = touched_voxels_.size();
+
+    if (thread_pool_) {
+      // Rays are split between the threads. Flags are set with an atomic
+      // OR, so every voxel is recorded by exactly one thread. Lists are
+      // cleared here, parallelFor does not call every thread for small
+      // ranges.
+      for (std::vector<Vector3i> &touched : thread_touched_voxels_) touched.clear();
+
+      thread_pool_->parallelFor(0, num_endpoints, [&](int t, int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+          insertFreeBresenham3DAtomic(touched_voxels_[i], origin_idx, thread_touched_voxels_[t]);
+        }
+      });
+
+      for (const std::vector<Vector3i> &touched : thread_touched_voxels_) {
+        touched_voxels_.insert(touched_voxels_.end(), touched.begin(), touched.end());
+      }
+
+    } else {
+      for (size_t i = 0; i < num_endpoints; ++i) {
+        Vector3i idx = touched_voxels_[i];
+        insertFreeBresenham3D(idx, origin_idx);
+      }
+    }
+
+    // Iterate over all marked voxels and update
+    for (const Vector3i &idx : touched_voxels_) {
+      _Flag & flag = voxel_buffer_.flag(idx);
+      _Datatype & occupancy_data = voxel_buffer_.occupancy(idx);
+
+      bool was_occupied = isOccupied(occupancy_data);
+      bool was_free = isFree(occupancy_data);
+
+      addHitOrMiss(occupancy_data, flag & occupied_flag);
+
+      bool is_occupied = isOccupied(occupancy_data);
+      updateCounters(was_occupied, was_free, occupancy_data);
+
+      flag &= ~insertion_flags;
+
+      if (was_occupied != is_occupied) {
+        flag |= updated_flag;
+        dirty_bricks_.set(brickSlot(getBrick(idx)));
+        if (record_changed_voxels_) changed_voxels_.push_back(idx);
+
+        updated_min_ = updated_min_.array().min(idx.array());
+        updated_max_ = updated_max_.array().max(idx.array());
+      }
+    }
+  }
+
+  // Marks all bricks that overlap num_slices slices along axis, starting at
+  // voxel index first_slice.
+  void markDirtySlab(int axis, int first_slice, int num_slices) {
+    const int first_brick = first_slice >> _BRICK_POW;
+    const int last_brick = std::min((first_slice + num_slices - 1) >> _BRICK_POW,
+                                    first_brick + _NUM_BRICKS - 1);
+
+    for (int b = first_brick; b <= last_brick; b++) {
+      for (int i = 0; i < _NUM_BRICKS; i++) {
+        for (int j = 0; j < _NUM_BRICKS; j++) {
+          Vector3i brick;
+          brick[axis] = b;
+          brick[(axis + 1) % 3] = i;
+          brick[(axis + 2) % 3] = j;
+          dirty_bricks_.set(brickSlot(brick));
+        }
+      }
+    }
+  }
+
   void closestPointInVolume(const Vector3 &point,
                            const Vector3 &origin,
                            Vector3 &res) {
@@ -363,7 +676,7 @@ class RaycastRingBuffer {
       if (std::abs(diff[i]) > 0) {
         _Scalar t1, t2;
         Vector3i offset;
-        occupancy_buffer_.getOffset(offset);
+        voxel_buffer_.getOffset(offset);
 
         t1 = ((offset[i] + 0.5) * resolution_ - origin[i]) / diff[i];
         if (t1 > 0 && t1 < min_t) min_t = t1;
@@ -384,8 +697,8 @@ class RaycastRingBuffer {
                   const Vector3i &origin_idx) {
 
     Vector3 point, origin;
-    occupancy_buffer_.getPoint(point_idx, point);
-    occupancy_buffer_.getPoint(origin_idx, origin);
+    voxel_buffer_.getPoint(point_idx, point);
+    voxel_buffer_.getPoint(origin_idx, origin);
 
     Vector3 dir = origin - point;
 
@@ -396,14 +709,34 @@ class RaycastRingBuffer {
       Vector3 intermediate_point = point + dir * i;
 
       Vector3i intermediate_idx;
-      occupancy_buffer_.getIdx(intermediate_point, intermediate_idx);
+      voxel_buffer_.getIdx(intermediate_point, intermediate_idx);
 
-      flag_buffer_.at(intermediate_idx) |= free_flag;
+      markVoxel(intermediate_idx, free_flag);
     }
   }
 
   void insertFreeBresenham3D(const Vector3i &point_idx,
                              const Vector3i &origin_idx) {
+    traverseBresenham3D(point_idx, origin_idx,
+                        [this](const Vector3i &idx) { markVoxel(idx, free_flag); });
+  }
+
+  // Same as insertFreeBresenham3D, but safe to run concurrently for
+  // different rays. Newly touched voxels are appended to touched.
+  void insertFreeBresenham3DAtomic(const Vector3i &point_idx,
+                                   const Vector3i &origin_idx,
+                                   std::vector<Vector3i> &touched) {
+    traverseBresenham3D(point_idx, origin_idx,
+                        [&](const Vector3i &idx) {
+                          _Flag old_flag = __atomic_fetch_or(&voxel_buffer_.flag(idx), free_flag, __ATOMIC_RELAXED);
+                          if (!(old_flag & insertion_flags)) touched.push_back(idx);
+                        });
+  }
+
+  // Calls mark for every voxel on the line from point_idx to origin_idx.
+  template<typename F>
+  void traverseBresenham3D(const Vector3i &point_idx,
+                           const Vector3i &origin_idx, F mark) {
 
     int i, dx, dy, dz, l, m, n, x_inc, y_inc, z_inc, err_1, err_2, dx2, dy2,
         dz2;
@@ -431,7 +764,7 @@ class RaycastRingBuffer {
       err_1 = dy2 - l;
       err_2 = dz2 - l;
       for (i = 0; i < l; i++) {
-        flag_buffer_.at(Vector3i(point[0], point[1], point[2])) |= free_flag;
+        mark(Vector3i(point[0], point[1], point[2]));
         if (err_1 > 0) {
           point[1] += y_inc;
           err_1 -= dx2;
@@ -448,7 +781,7 @@ class RaycastRingBuffer {
       err_1 = dx2 - m;
       err_2 = dz2 - m;
       for (i = 0; i < m; i++) {
-        flag_buffer_.at(Vector3i(point[0], point[1], point[2])) |= free_flag;
+        mark(Vector3i(point[0], point[1], point[2]));
         if (err_1 > 0) {
           point[0] += x_inc;
           err_1 -= dy2;
@@ -465,7 +798,7 @@ class RaycastRingBuffer {
       err_1 = dy2 - n;
       err_2 = dx2 - n;
       for (i = 0; i < n; i++) {
-        flag_buffer_.at(Vector3i(point[0], point[1], point[2])) |= free_flag;
+        mark(Vector3i(point[0], point[1], point[2]));
         if (err_1 > 0) {
           point[1] += y_inc;
           err_1 -= dz2;
@@ -480,18 +813,32 @@ class RaycastRingBuffer {
       }
     }
 
-    flag_buffer_.at(Vector3i(point[0], point[1], point[2])) |= free_flag;
+    mark(Vector3i(point[0], point[1], point[2]));
   }
 
   _Scalar resolution_;
 
   Vector3i updated_min_, updated_max_;
 
-  // buffer to store occupancy information
-  RingBufferBase <_POW, _Datatype, _Scalar> occupancy_buffer_;
+  // one bit per brick, see isBrickDirty
+  std::bitset<_NUM_BRICKS * _NUM_BRICKS * _NUM_BRICKS> dirty_bricks_;
+
+  // buffer to store occupancy and insertion information
+  Storage voxel_buffer_;
+
+  // voxels marked during the current insertion
+  std::vector<Vector3i> touched_voxels_;
+
+  // workers and their touched voxel lists for parallel ray casting
+  std::unique_ptr<ThreadPool> thread_pool_;
+  std::vector<std::vector<Vector3i>> thread_touched_voxels_;
+
+  // number of occupied and free voxels in the volume
+  int num_occupied_, num_free_;
 
-  // buffer to store insertion information
-  RingBufferBase <_POW, _Flag, _Scalar> flag_buffer_;
+  // voxels that became occupied or stopped being occupied
+  bool record_changed_voxels_;
+  std::vector<Vector3i> changed_voxels_;
 
 };
 
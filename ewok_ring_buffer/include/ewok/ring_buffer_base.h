@@ -29,13 +29,71 @@
 #include <visualization_msgs/Marker.h>
 
 #include <vector>
+#include <map>
+#include <mutex>
 #include <algorithm>
 #include <math.h>
 
 
 namespace ewok {
 
-template<int _POW, typename _Datatype, typename _Scalar = float>
+// Memory layouts of the ring buffer. index() maps ring coordinates, each
+// in [0, 2^_POW), to the position in the linear storage.
+
+// x-major layout, z is the fastest changing coordinate.
+template<int _POW>
+struct LinearLayout {
+  static const bool is_linear = true;
+
+  static inline int index(int x, int y, int z) {
+    return (((x << _POW) + y) << _POW) + z;
+  }
+};
+
+// Voxels are grouped into bricks of 2^_BRICK_POW voxels per side. Bricks
+// and voxels inside a brick are stored x-major.
+template<int _POW, int _BRICK_POW>
+struct BrickedLayoutBase {
+  static const bool is_linear = false;
+
+  static const int _B = _BRICK_POW < _POW ? _BRICK_POW : _POW;
+  static const int _B_MASK = (1 << _B) - 1;
+  static const int _NB_POW = _POW - _B;
+
+  static inline int index(int x, int y, int z) {
+    const int brick = (((((x >> _B) << _NB_POW) + (y >> _B)) << _NB_POW) + (z >> _B));
+    const int voxel = (((((x & _B_MASK) << _B) + (y & _B_MASK)) << _B) + (z & _B_MASK));
+    return (brick << (3 * _B)) + voxel;
+  }
+};
+
+template<int _POW>
+using Bricked4Layout = BrickedLayoutBase<_POW, 2>;
+
+template<int _POW>
+using Bricked8Layout = BrickedLayoutBase<_POW, 3>;
+
+// Morton (Z-order) layout, bits of x, y and z are interleaved. Supports
+// up to 2^10 voxels per side.
+template<int _POW>
+struct MortonLayout {
+  static const bool is_linear = false;
+
+  static inline int spread(unsigned int v) {
+    v = (v | (v << 16)) & 0x030000FF;
+    v = (v | (v << 8)) & 0x0300F00F;
+    v = (v | (v << 4)) & 0x030C30C3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+  }
+
+  static inline int index(int x, int y, int z) {
+    return (spread(x) << 2) | (spread(y) << 1) | spread(z);
+  }
+};
+
+template<int _POW, typename _Datatype, typename _Scalar = float,
+         template<int> class _Layout = LinearLayout>
 class RingBufferBase {
  public:
 
@@ -48,6 +106,8 @@ class RingBufferBase {
   typedef Eigen::Matrix<_Scalar, 4, 1> Vector4;
   typedef Eigen::Matrix<int, 3, 1> Vector3i;
 
+  typedef _Layout<_POW> Layout;
+
   explicit RingBufferBase(const _Scalar & resolution,
                           const _Datatype & empty_element = _Datatype())
       : resolution_(resolution), empty_element_(empty_element),
@@ -81,62 +141,59 @@ class RingBufferBase {
       o = offset_;
   }
 
-  // Moves 1 step in the direction
+  // Moves the volume by direction voxels. Slabs of voxels that enter the
+  // volume are reset to the empty element. If the shift along any axis is
+  // at least _N nothing is kept and the whole buffer is reset.
   virtual void moveVolume(const Vector3i &direction) {
 
-      for (int axis = 0; axis < 3; axis++) {
-          if (direction[axis] != 0) {
+      if ((direction.array().abs() >= _N).any()) {
+          offset_ += direction;
+          std::fill(buffer_.begin(), buffer_.end(), empty_element_);
+          return;
+      }
 
-              int slice;
+      for (int axis = 0; axis < 3; axis++) {
+          const int shift = direction[axis];
+          if (shift == 0) continue;
+
+          // Entering slices occupy the storage of the leaving ones
+          if (shift > 0) {
+              setSlab(axis, offset_[axis], shift, empty_element_);
+          } else {
+              setSlab(axis, offset_[axis] + _N + shift, -shift, empty_element_);
+          }
 
-              if (direction[axis] > 0) {
-                  offset_[axis]++;
-                  slice = offset_[axis] + _N - 1;
-              } else {
-                  offset_[axis]--;
-                  slice = offset_[axis];
-              }
+          offset_[axis] += shift;
+      }
 
-              switch (axis) {
-                  case 0:setXSlice(slice, empty_element_);
-                  break;
-                  case 1:setYSlice(slice, empty_element_);
-                  break;
-                  case 2:setZSlice(slice, empty_element_);
-                  break;
+  }
 
-              }
+  // Calls func(begin, end) for the contiguous memory ranges that hold
+  // num_slices slices along axis, starting at slice first_slice.
+  template<typename F>
+  void forEachSlabRange(int axis, int first_slice, int num_slices, F func) {
+      const int begin = first_slice & _MASK;
+      const int end = begin + std::min(num_slices, _N);
 
-          }
-      }
+      forEachSlabRangeNoWrap(axis, begin, std::min(end, _N), func);
+      if (end > _N) forEachSlabRangeNoWrap(axis, 0, end - _N, func);
+  }
 
+  void setSlab(int axis, int first_slice, int num_slices, const _Datatype &data) {
+      forEachSlabRange(axis, first_slice, num_slices,
+                       [&](_Datatype * begin, _Datatype * end) { for (; begin != end; ++begin) *begin = data; });
   }
 
   void setXSlice(int slice_idx, const _Datatype &data) {
-      for (int i = 0; i < _N; i++) {
-          for (int j = 0; j < _N; j++) {
-              Vector3i idx(slice_idx, i, j);
-              this->at(idx) = data;
-          }
-      }
+      setSlab(0, slice_idx, 1, data);
   }
 
   void setYSlice(int slice_idx, const _Datatype &data) {
-      for (int i = 0; i < _N; i++) {
-          for (int j = 0; j < _N; j++) {
-              Vector3i idx(i, slice_idx, j);
-              this->at(idx) = data;
-          }
-      }
+      setSlab(1, slice_idx, 1, data);
   }
 
   void setZSlice(int slice_idx, const _Datatype &data) {
-      for (int i = 0; i < _N; i++) {
-          for (int j = 0; j < _N; j++) {
-              Vector3i idx(i, j, slice_idx);
-              this->at(idx) = data;
-          }
-      }
+      setSlab(2, slice_idx, 1, data);
   }
 
   inline bool insideVolume(const Vector3i &coord) {
@@ -161,7 +218,7 @@ class RingBufferBase {
           idx[i] = coord[i] & _MASK;
       }
 
-      return buffer_[_N * _N * idx[0] + _N * idx[1] + idx[2]];
+      return buffer_[Layout::index(idx[0], idx[1], idx[2])];
   }
 
   inline _Datatype at(const Vector3i &coord) const {
@@ -172,7 +229,7 @@ class RingBufferBase {
           idx[i] = coord[i] & _MASK;
       }
 
-      return buffer_[_N * _N * idx[0] + _N * idx[1] + idx[2]];
+      return buffer_[Layout::index(idx[0], idx[1], idx[2])];
   }
 
   inline Vector3i getVolumeCenter() {
@@ -180,52 +237,69 @@ class RingBufferBase {
       return offset_ + inc;
   }
 
-  template<typename F>
-  inline bool isPointNear(const Vector3 & point, const _Scalar & rad, F func)
-  {
-      bool found = false;
-      for (int x = 0; x < _N; x++) {
-          for (int y = 0; y < _N; y++) {
-              for (int z = 0; z < _N; z++) {
+  // Returns the offsets of all voxels inside the cylinder checked by isPointNear,
+  // sorted by distance from the center. Stencils are cached per radius and
+  // stay valid for the lifetime of the buffer. The lookup takes a lock, so
+  // callers that check many points resolve the stencil once.
+  const std::vector<Vector3i> & getNeighborhoodStencil(const _Scalar & rad) {
+      std::lock_guard<std::mutex> lock(stencil_mutex_);
 
+      typename std::map<_Scalar, std::vector<Vector3i>>::iterator it = stencils_.find(rad);
+      if (it != stencils_.end()) return it->second;
 
-                  Vector3i coord(x, y, z);
-                  coord += offset_;
+      _Scalar height_diff = rad/2;
+      if(height_diff < 0.3) height_diff = 0.3;
+
+      const int r = std::ceil(rad / resolution_);
+      const int h = std::ceil(height_diff / resolution_);
+
+      std::vector<Vector3i> & stencil = stencils_[rad];
+
+      for (int x = -r; x <= r; x++) {
+          for (int y = -r; y <= r; y++) {
+              for (int z = -h; z <= h; z++) {
+                  Vector3i offset(x, y, z);
+                  Vector3 diff = offset.template cast<_Scalar>() * resolution_;
 
-                  Vector3 center;
-                  getPoint(coord, center);
-
-                  Vector3i p_idx;
-                  Vector3 p_point;
-                  getIdx(point, p_idx);
-                  getPoint(p_idx, p_point);
-
-                  Vector3 diff = p_point-center;
-                  _Scalar height_diff = rad/2;
-                  if(height_diff < 0.3) height_diff = 0.3;
-                  if(std::fabs(diff.z()) < height_diff)
-                  {
-                      if(diff.dot(diff) < pow(rad,2))
-                      {
-                          _Datatype &data = this->at(coord);
-
-                          if (func(data))
-                          {
-                              found=true;
-                              break;
-                          }
-                      }
+                  if (std::fabs(diff.z()) < height_diff && diff.dot(diff) < rad * rad) {
+                      stencil.push_back(offset);
                   }
               }
-
-              if(found) break;
           }
-          if(found) break;
       }
 
+      std::sort(stencil.begin(), stencil.end(),
+                [](const Vector3i & a, const Vector3i & b) { return a.squaredNorm() < b.squaredNorm(); });
+
+      return stencil;
+  }
+
+  // Checks if func is true for any voxel inside the cylinder around point.
+  // Only the voxels in the precomputed stencil are visited, closest first.
+  template<typename F>
+  inline bool isPointNear(const Vector3 & point, const _Scalar & rad, F func)
+  {
+      return isPointNear(point, getNeighborhoodStencil(rad), func);
+  }
+
+  // Same as above with a stencil from getNeighborhoodStencil. Takes no lock.
+  template<typename F>
+  inline bool isPointNear(const Vector3 & point, const std::vector<Vector3i> & stencil, F func)
+  {
+      Vector3i p_idx;
+      getIdx(point, p_idx);
+
+      for (const Vector3i & offset : stencil) {
+          Vector3i coord = p_idx + offset;
+
+          if (!insideVolume(coord)) continue;
+
+          _Datatype &data = this->at(coord);
 
-      return found;
+          if (func(data)) return true;
+      }
 
+      return false;
   }
 
   template<typename F>
@@ -278,11 +352,55 @@ class RingBufferBase {
 
  protected:
 
+  // Slices [begin, end) in storage coordinates, 0 <= begin < end <= _N.
+  // Non-linear layouts are visited voxel by voxel.
+  template<typename F>
+  void forEachSlabRangeNoWrap(int axis, int begin, int end, F func) {
+      _Datatype * data = buffer_.data();
+
+      if (!Layout::is_linear) {
+          Vector3i min(0, 0, 0), max(_N, _N, _N);
+          min[axis] = begin;
+          max[axis] = end;
+
+          for (int x = min[0]; x < max[0]; x++) {
+              for (int y = min[1]; y < max[1]; y++) {
+                  for (int z = min[2]; z < max[2]; z++) {
+                      _Datatype * d = data + Layout::index(x, y, z);
+                      func(d, d + 1);
+                  }
+              }
+          }
+          return;
+      }
+
+      switch (axis) {
+          case 0:
+              func(data + _N * _N * begin, data + _N * _N * end);
+              break;
+          case 1:
+              for (int x = 0; x < _N; x++) {
+                  func(data + _N * _N * x + _N * begin, data + _N * _N * x + _N * end);
+              }
+              break;
+          case 2:
+              for (int x = 0; x < _N; x++) {
+                  for (int y = 0; y < _N; y++) {
+                      func(data + _N * _N * x + _N * y + begin, data + _N * _N * x + _N * y + end);
+                  }
+              }
+              break;
+      }
+  }
+
   _Scalar resolution_;
   _Datatype empty_element_;
 
   Vector3i offset_;
   std::vector<_Datatype> buffer_;
+
+  std::map<_Scalar, std::vector<Vector3i>> stencils_;
+  std::mutex stencil_mutex_;
 };
 
 }
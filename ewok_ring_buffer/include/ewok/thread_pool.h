@@ -0,0 +1,135 @@
+/**
+* This file is part of Ewok.
+*
+* Copyright 2017 Vladyslav Usenko, Technical University of Munich.
+* Developed by Vladyslav Usenko <vlad dot usenko at tum dot de>,
+* for more information see <http://vision.in.tum.de/research/robotvision/replanning>.
+* If you use this code, please cite the respective publications as
+* listed on the above website.
+*
+* Ewok is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* Ewok is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with Ewok. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef EWOK_RING_BUFFER_INCLUDE_EWOK_THREAD_POOL_H_
+#define EWOK_RING_BUFFER_INCLUDE_EWOK_THREAD_POOL_H_
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ewok {
+
+// Fixed set of worker threads that execute parallel loops. The calling
+// thread takes part in every loop, so a pool of size 1 has no workers
+// and runs everything inline.
+class ThreadPool {
+ public:
+
+  explicit ThreadPool(int num_threads)
+      : stop_(false), generation_(0), pending_(0), job_(nullptr) {
+    for (int i = 1; i < num_threads; i++) {
+      workers_.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    start_cv_.notify_all();
+
+    for (std::thread & t : workers_) t.join();
+  }
+
+  inline int size() const {
+    return workers_.size() + 1;
+  }
+
+  // Splits [begin, end) into size() contiguous chunks and calls
+  // func(thread_idx, chunk_begin, chunk_end) for each of them.
+  // Returns after all chunks are processed.
+  template<typename F>
+  void parallelFor(int begin, int end, F func) {
+    const int num_threads = size();
+
+    if (num_threads == 1 || end - begin <= 1) {
+      func(0, begin, end);
+      return;
+    }
+
+    std::lock_guard<std::mutex> call_lock(call_mutex_);
+
+    const int n = end - begin;
+    std::function<void(int)> job = [&](int t) {
+      func(t, begin + (n * t) / num_threads, begin + (n * (t + 1)) / num_threads);
+    };
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      job_ = &job;
+      pending_ = num_threads - 1;
+      generation_++;
+    }
+    start_cv_.notify_all();
+
+    job(0);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] { return pending_ == 0; });
+    job_ = nullptr;
+  }
+
+ private:
+
+  void workerLoop(int thread_idx) {
+    size_t last_generation = 0;
+
+    while (true) {
+      const std::function<void(int)> * job;
+
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        start_cv_.wait(lock, [&] { return stop_ || generation_ != last_generation; });
+        if (stop_) return;
+
+        last_generation = generation_;
+        job = job_;
+      }
+
+      (*job)(thread_idx);
+
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--pending_ == 0) done_cv_.notify_one();
+      }
+    }
+  }
+
+  std::vector<std::thread> workers_;
+
+  std::mutex mutex_, call_mutex_;
+  std::condition_variable start_cv_, done_cv_;
+
+  bool stop_;
+  size_t generation_;
+  int pending_;
+  const std::function<void(int)> * job_;
+};
+
+}
+
+#endif // EWOK_RING_BUFFER_INCLUDE_EWOK_THREAD_POOL_H_
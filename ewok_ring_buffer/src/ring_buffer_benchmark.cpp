@@ -0,0 +1,629 @@
+/**
+* This file is part of Ewok.
+*
+* Copyright 2017 Vladyslav Usenko, Technical University of Munich.
+* Developed by Vladyslav Usenko <vlad dot usenko at tum dot de>,
+* for more information see <http://vision.in.tum.de/research/robotvision/replanning>.
+* If you use this code, please cite the respective publications as
+* listed on the above website.
+*
+* Ewok is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* Ewok is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with Ewok. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+
+#include <ewok/ed_ring_buffer.h>
+
+const int POW = 6;
+
+typedef ewok::RaycastRingBuffer<POW, int16_t, float> RRB;
+
+// Generates synthetic depth frames: a camera at the volume center looking
+// along x at a wavy wall, downsampled 640x480 with a 2 pixel step.
+void createFrames(int num_frames, std::vector<RRB::PointCloud> & frames,
+                  std::vector<Eigen::Vector3f> & origins)
+{
+    const float fx = 525.0f, fy = 525.0f, cx = 319.5f, cy = 239.5f;
+
+    for (int f = 0; f < num_frames; f++) {
+        Eigen::Vector3f origin(0.05f * f, 0, 0);
+        RRB::PointCloud cloud;
+
+        for (int v = 0; v < 480; v += 2) {
+            for (int u = 0; u < 640; u += 2) {
+                float d = 1.2f + 0.3f * std::sin(0.02f * u + 0.1f * f) * std::cos(0.03f * v);
+                float x = (u - cx) * d / fx;
+                float y = (v - cy) * d / fy;
+                cloud.push_back(Eigen::Vector4f(origin[0] + d, origin[1] + x, origin[2] + y, 0));
+            }
+        }
+
+        frames.push_back(cloud);
+        origins.push_back(origin);
+    }
+}
+
+// Inserts all frames and returns the time spent in insertPointCloud.
+template<typename _RRB>
+double runFrames(_RRB & rrb, const std::vector<RRB::PointCloud> & frames,
+                 const std::vector<Eigen::Vector3f> & origins)
+{
+    double seconds = 0;
+
+    for (size_t i = 0; i < frames.size(); i++) {
+        auto t1 = std::chrono::high_resolution_clock::now();
+        rrb.insertPointCloud(frames[i], origins[i]);
+        auto t2 = std::chrono::high_resolution_clock::now();
+        seconds += std::chrono::duration<double>(t2 - t1).count();
+    }
+
+    return seconds;
+}
+
+typedef std::chrono::high_resolution_clock Clock;
+
+// Times insertPointCloud and moveVolume for separate or interleaved
+// occupancy and flag storage. The volume follows the camera by one voxel
+// per frame, like in the replanning nodes.
+template<bool _Interleaved>
+void benchmarkStorage(const std::string & name,
+                      const std::vector<RRB::PointCloud> & frames,
+                      const std::vector<Eigen::Vector3f> & origins,
+                      int & num_occupied)
+{
+    typedef ewok::RaycastRingBuffer<POW, int16_t, float, uint8_t, ewok::LinearLayout, _Interleaved> StorageRRB;
+
+    const int num_repeats = 5;
+    double insert_seconds = 0, move_seconds = 0;
+
+    for (int r = 0; r < num_repeats; r++) {
+        StorageRRB rrb(0.05);
+
+        for (size_t i = 0; i < frames.size(); i++) {
+            auto t1 = Clock::now();
+            rrb.insertPointCloud(frames[i], origins[i]);
+            auto t2 = Clock::now();
+            rrb.moveVolume(Eigen::Vector3i(1, 0, 0));
+            auto t3 = Clock::now();
+
+            insert_seconds += std::chrono::duration<double>(t2 - t1).count();
+            move_seconds += std::chrono::duration<double>(t3 - t2).count();
+        }
+
+        int free, unknown;
+        rrb.getVoxelCounts(num_occupied, free, unknown);
+    }
+
+    const int num_frames = num_repeats * frames.size();
+
+    std::cout << std::setw(12) << name
+              << " insert [ms/frame]: " << 1e3 * insert_seconds / num_frames
+              << " move [us/frame]: " << 1e6 * move_seconds / num_frames;
+}
+
+// Times insertPointCloud, updateDistance and getDistanceWithGrad for an
+// EDRB with the given memory layout. Distances at the query points are
+// stored for comparison with the other layouts.
+template<template<int> class _Layout>
+void benchmarkLayout(const std::string & name,
+                     const std::vector<RRB::PointCloud> & frames,
+                     const std::vector<Eigen::Vector3f> & origins,
+                     const std::vector<Eigen::Vector3f> & queries,
+                     std::vector<float> & distances)
+{
+    typedef ewok::EuclideanDistanceRingBuffer<POW, int16_t, float, uint8_t, _Layout> EDRB;
+
+    EDRB edrb(0.05, 0.5);
+
+    double insert_seconds = 0, edt_seconds = 0;
+
+    for (size_t i = 0; i < frames.size(); i++) {
+        auto t1 = Clock::now();
+        edrb.insertPointCloud(frames[i], origins[i]);
+        auto t2 = Clock::now();
+        edrb.updateDistance();
+        auto t3 = Clock::now();
+
+        insert_seconds += std::chrono::duration<double>(t2 - t1).count();
+        edt_seconds += std::chrono::duration<double>(t3 - t2).count();
+    }
+
+    distances.resize(queries.size());
+    Eigen::Vector3f grad;
+
+    auto t1 = Clock::now();
+    for (size_t i = 0; i < queries.size(); i++) {
+        distances[i] = edrb.getDistanceWithGrad(queries[i], grad);
+    }
+    auto t2 = Clock::now();
+    double query_seconds = std::chrono::duration<double>(t2 - t1).count();
+
+    std::cout << std::setw(9) << name
+              << " insert [ms/frame]: " << 1e3 * insert_seconds / frames.size()
+              << " edt [ms/frame]: " << 1e3 * edt_seconds / frames.size()
+              << " queries [M/s]: " << 1e-6 * queries.size() / query_seconds;
+}
+
+// EDRB that stores distances as _Distance. Reports the distance buffer
+// size and the largest difference from the reference distances.
+template<int _POW, typename _Distance>
+void benchmarkDistanceStorage(const std::string & name,
+                              const std::vector<RRB::PointCloud> & frames,
+                              const std::vector<Eigen::Vector3f> & origins,
+                              const std::vector<Eigen::Vector3f> & queries,
+                              std::vector<float> & reference_distances)
+{
+    typedef ewok::EuclideanDistanceRingBuffer<_POW, int16_t, float, uint8_t, ewok::LinearLayout, false, _Distance> EDRB;
+
+    EDRB edrb(0.05, 0.5);
+
+    double edt_seconds = 0;
+
+    for (size_t i = 0; i < frames.size(); i++) {
+        edrb.insertPointCloud(frames[i], origins[i]);
+
+        auto t1 = Clock::now();
+        edrb.updateDistance();
+        auto t2 = Clock::now();
+        edt_seconds += std::chrono::duration<double>(t2 - t1).count();
+    }
+
+    std::vector<float> distances(queries.size());
+    Eigen::Vector3f grad;
+
+    auto t1 = Clock::now();
+    for (size_t i = 0; i < queries.size(); i++) {
+        distances[i] = edrb.getDistanceWithGrad(queries[i], grad);
+    }
+    auto t2 = Clock::now();
+    double query_seconds = std::chrono::duration<double>(t2 - t1).count();
+
+    if (reference_distances.empty()) reference_distances = distances;
+
+    float max_error = 0;
+    for (size_t i = 0; i < queries.size(); i++) {
+        max_error = std::max(max_error, std::abs(distances[i] - reference_distances[i]));
+    }
+
+    std::cout << std::setw(9) << name << " " << (1 << _POW) << "^3"
+              << " distance buffer [MB]: " << sizeof(_Distance) * (1 << (3 * _POW)) / 1048576.0
+              << " edt [ms/frame]: " << 1e3 * edt_seconds / frames.size()
+              << " queries [M/s]: " << 1e-6 * queries.size() / query_seconds
+              << " max difference [m]: " << max_error << std::endl;
+}
+
+// Times a full-volume distance update with 1 to max_threads threads.
+// All bricks of a new buffer are dirty, so the map is built again for
+// every repeat. If reference distances are given, the results are
+// compared to them.
+template<int _POW>
+void benchmarkEdtThreads(int max_threads, bool vectorized, bool signed_distance,
+                         const std::vector<RRB::PointCloud> & frames,
+                         const std::vector<Eigen::Vector3f> & origins,
+                         const std::vector<Eigen::Vector3f> & queries,
+                         std::vector<float> & serial_distances)
+{
+    typedef ewok::EuclideanDistanceRingBuffer<_POW, int16_t, float> EDRB;
+
+    const int num_repeats = 10;
+    double serial_seconds = 0;
+
+    for (int num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+        std::vector<float> distances(queries.size());
+
+        double seconds = 0;
+        for (int r = 0; r < num_repeats; r++) {
+            EDRB edrb(0.05, 0.5);
+            edrb.setVectorizedEdt(vectorized);
+            edrb.setSignedDistance(signed_distance);
+            for (size_t i = 0; i < frames.size(); i++) {
+                edrb.insertPointCloud(frames[i], origins[i]);
+            }
+
+            auto t1 = Clock::now();
+            edrb.updateDistance(num_threads);
+            auto t2 = Clock::now();
+            seconds += std::chrono::duration<double>(t2 - t1).count();
+
+            Eigen::Vector3f grad;
+            for (size_t i = 0; i < queries.size(); i++) {
+                distances[i] = edrb.getDistanceWithGrad(queries[i], grad);
+            }
+        }
+
+        if (num_threads == 1) {
+            serial_seconds = seconds;
+            if (serial_distances.empty()) serial_distances = distances;
+        }
+
+        std::cout << "edt " << (vectorized ? "vectorized " : "") << (signed_distance ? "signed " : "") << (1 << _POW) << "^3 threads: " << num_threads
+                  << " time [ms]: " << 1e3 * seconds / num_repeats
+                  << " speedup: " << std::setprecision(2) << serial_seconds / seconds
+                  << std::setprecision(4)
+                  << " identical: " << (distances == serial_distances ? "yes" : "no") << std::endl;
+    }
+}
+
+// Times the distance update per frame with the batch or the incremental
+// transform. If move_every is positive, the volume moves by one voxel
+// every move_every frames. Afterwards sparse frames with one point near
+// each of two opposite corners are inserted. Distances at the query
+// points after the last frame are returned.
+void benchmarkIncremental(bool incremental, int move_every,
+                          const std::vector<RRB::PointCloud> & frames,
+                          const std::vector<Eigen::Vector3f> & origins,
+                          const std::vector<Eigen::Vector3f> & queries,
+                          std::vector<float> & distances)
+{
+    typedef ewok::EuclideanDistanceRingBuffer<POW, int16_t, float> EDRB;
+
+    EDRB edrb(0.05, 0.5);
+    edrb.setIncrementalEdt(incremental);
+
+    double seconds = 0, max_seconds = 0;
+
+    for (size_t i = 0; i < frames.size(); i++) {
+        edrb.insertPointCloud(frames[i], origins[i]);
+        if (move_every > 0 && i % move_every == 0) edrb.moveVolume(Eigen::Vector3i(0, 0, 1));
+
+        auto t1 = Clock::now();
+        edrb.updateDistance();
+        auto t2 = Clock::now();
+
+        const double s = std::chrono::duration<double>(t2 - t1).count();
+        seconds += s;
+        max_seconds = std::max(max_seconds, s);
+    }
+
+    const int num_sparse = 30;
+    double sparse_seconds = 0;
+
+    for (int i = 0; i < num_sparse; i++) {
+        Eigen::Vector3f min_point, max_point;
+        edrb.getVolumeMinMax(min_point, max_point);
+        Eigen::Vector3f origin = 0.5f * (min_point + max_point);
+
+        RRB::PointCloud cloud;
+        cloud.push_back(Eigen::Vector4f(min_point[0] + 0.3f, min_point[1] + 0.3f, min_point[2] + 0.3f + 0.05f * i, 0));
+        cloud.push_back(Eigen::Vector4f(max_point[0] - 0.3f, max_point[1] - 0.3f, max_point[2] - 0.3f - 0.05f * i, 0));
+        // Two hits make a voxel occupied
+        edrb.insertPointCloud(cloud, origin);
+        edrb.insertPointCloud(cloud, origin);
+
+        auto t1 = Clock::now();
+        edrb.updateDistance();
+        auto t2 = Clock::now();
+        sparse_seconds += std::chrono::duration<double>(t2 - t1).count();
+    }
+
+    // Compare after a move, which also updates the faces
+    edrb.moveVolume(Eigen::Vector3i(0, 0, 1));
+    edrb.updateDistance();
+
+    distances.resize(queries.size());
+    Eigen::Vector3f grad;
+    for (size_t i = 0; i < queries.size(); i++) {
+        distances[i] = edrb.getDistanceWithGrad(queries[i], grad);
+    }
+
+    std::cout << std::setw(12) << (incremental ? "incremental" : "batch")
+              << " move every: " << move_every
+              << " update [ms/frame]: " << 1e3 * seconds / frames.size()
+              << " max [ms]: " << 1e3 * max_seconds
+              << " sparse [ms/frame]: " << 1e3 * sparse_seconds / num_sparse;
+}
+
+// Times the distance update plus queries along a corridor per frame, with
+// the eager or the lazy transform. The corridor runs from the camera
+// towards the wall like the samples of a planned trajectory. Distances
+// queried in the last frame are returned.
+template<int _POW>
+void benchmarkLazy(bool lazy,
+                   const std::vector<RRB::PointCloud> & frames,
+                   const std::vector<Eigen::Vector3f> & origins,
+                   std::vector<float> & distances)
+{
+    typedef ewok::EuclideanDistanceRingBuffer<_POW, int16_t, float> EDRB;
+
+    EDRB edrb(0.05, 0.5);
+    edrb.setLazyEdt(lazy);
+
+    const int num_samples = 200;
+    double seconds = 0;
+
+    for (size_t i = 0; i < frames.size(); i++) {
+        edrb.insertPointCloud(frames[i], origins[i]);
+
+        auto t1 = Clock::now();
+        edrb.updateDistance();
+
+        distances.resize(num_samples);
+        Eigen::Vector3f grad;
+        for (int j = 0; j < num_samples; j++) {
+            const float t = float(j) / num_samples;
+            Eigen::Vector3f q = origins[i] + Eigen::Vector3f(1.2f * t, 0.3f * t, 0.1f * std::sin(10.0f * t));
+            distances[j] = edrb.getDistanceWithGrad(q, grad);
+        }
+        auto t2 = Clock::now();
+        seconds += std::chrono::duration<double>(t2 - t1).count();
+    }
+
+    std::cout << std::setw(6) << (lazy ? "lazy" : "eager") << " " << (1 << _POW) << "^3"
+              << " update and queries [ms/frame]: " << 1e3 * seconds / frames.size();
+}
+
+// Times the distance update per frame and getDistanceWithGrad with and
+// without the stored gradient field. Distances at the query points after
+// the last frame are returned.
+template<int _POW>
+void benchmarkGradientField(bool gradient_field,
+                            const std::vector<RRB::PointCloud> & frames,
+                            const std::vector<Eigen::Vector3f> & origins,
+                            const std::vector<Eigen::Vector3f> & queries,
+                            std::vector<float> & distances)
+{
+    typedef ewok::EuclideanDistanceRingBuffer<_POW, int16_t, float> EDRB;
+
+    EDRB edrb(0.05, 0.5);
+    edrb.setGradientField(gradient_field);
+
+    double edt_seconds = 0;
+
+    for (size_t i = 0; i < frames.size(); i++) {
+        edrb.insertPointCloud(frames[i], origins[i]);
+
+        auto t1 = Clock::now();
+        edrb.updateDistance();
+        auto t2 = Clock::now();
+        edt_seconds += std::chrono::duration<double>(t2 - t1).count();
+    }
+
+    distances.resize(queries.size());
+    Eigen::Vector3f grad;
+
+    auto t1 = Clock::now();
+    for (size_t i = 0; i < queries.size(); i++) {
+        distances[i] = edrb.getDistanceWithGrad(queries[i], grad);
+    }
+    auto t2 = Clock::now();
+    double query_seconds = std::chrono::duration<double>(t2 - t1).count();
+
+    std::cout << std::setw(14) << (gradient_field ? "gradient field" : "interpolated")
+              << " " << (1 << _POW) << "^3"
+              << " edt [ms/frame]: " << 1e3 * edt_seconds / frames.size()
+              << " queries [M/s]: " << 1e-6 * queries.size() / query_seconds
+              << " gradient field [MB]: " << edrb.getGradientFieldBytes() / 1048576.0;
+}
+
+// Queries the distances of all queries one by one and in batches of
+// batch_size, as the spline optimization does for its collision samples.
+template<int _POW>
+void benchmarkBatchQueries(int batch_size,
+                           const std::vector<RRB::PointCloud> & frames,
+                           const std::vector<Eigen::Vector3f> & origins,
+                           const std::vector<Eigen::Vector3f> & queries)
+{
+    typedef ewok::EuclideanDistanceRingBuffer<_POW, int16_t, float> EDRB;
+
+    EDRB edrb(0.05, 0.5);
+
+    for (size_t i = 0; i < frames.size(); i++) {
+        edrb.insertPointCloud(frames[i], origins[i]);
+        edrb.updateDistance();
+    }
+
+    const int num_batches = queries.size() / batch_size;
+    const int num_queries = num_batches * batch_size;
+
+    std::vector<float> distances(num_queries);
+    Eigen::Vector3f grad;
+
+    auto t1 = Clock::now();
+    for (int i = 0; i < num_queries; i++) {
+        distances[i] = edrb.getDistanceWithGrad(queries[i], grad);
+    }
+    auto t2 = Clock::now();
+    double single_seconds = std::chrono::duration<double>(t2 - t1).count();
+
+    typename EDRB::Matrix3X points(3, batch_size), grads;
+    typename EDRB::VectorX batch_distances;
+    float max_difference = 0;
+
+    double batch_seconds = 0;
+    for (int b = 0; b < num_batches; b++) {
+        for (int k = 0; k < batch_size; k++) {
+            points.col(k) = queries[b * batch_size + k];
+        }
+
+        t1 = Clock::now();
+        edrb.getDistancesWithGrad(points, batch_distances, grads);
+        t2 = Clock::now();
+        batch_seconds += std::chrono::duration<double>(t2 - t1).count();
+
+        for (int k = 0; k < batch_size; k++) {
+            max_difference = std::max(max_difference, std::abs(batch_distances[k] - distances[b * batch_size + k]));
+        }
+    }
+
+    std::cout << (1 << _POW) << "^3 batch " << std::setw(4) << batch_size
+              << " single [M/s]: " << 1e-6 * num_queries / single_seconds
+              << " batched [M/s]: " << 1e-6 * num_queries / batch_seconds
+              << " max difference [m]: " << max_difference << std::endl;
+}
+
+// Largest difference between distances of two runs. Layouts compile the
+// interpolation differently, so results can differ in the last bit.
+float maxDifference(const std::vector<float> & a, const std::vector<float> & b)
+{
+    float max_difference = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        max_difference = std::max(max_difference, std::abs(a[i] - b[i]));
+    }
+    return max_difference;
+}
+
+bool sameMap(RRB & a, RRB & b)
+{
+    const int N = RRB::_N;
+    Eigen::Vector3i offset = a.getVolumeCenter() - Eigen::Vector3i(N / 2, N / 2, N / 2);
+
+    for (int x = 0; x < N; x++) {
+        for (int y = 0; y < N; y++) {
+            for (int z = 0; z < N; z++) {
+                Eigen::Vector3i idx = offset + Eigen::Vector3i(x, y, z);
+                if (a.isOccupied(idx) != b.isOccupied(idx) || a.isFree(idx) != b.isFree(idx) ||
+                    a.isUpdated(idx) != b.isUpdated(idx)) return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    int num_frames = argc > 1 ? std::atoi(argv[1]) : 30;
+    int max_threads = argc > 2 ? std::atoi(argv[2]) : 16;
+
+    std::vector<RRB::PointCloud> frames;
+    std::vector<Eigen::Vector3f> origins;
+    createFrames(num_frames, frames, origins);
+
+    RRB reference(0.05);
+    double serial_seconds = runFrames(reference, frames, origins);
+
+    std::cout << std::fixed << std::setprecision(4);
+    std::cout << "threads: 1 time [s]: " << serial_seconds << " speedup: 1.00" << std::endl;
+
+    for (int num_threads = 2; num_threads <= max_threads; num_threads *= 2) {
+        RRB rrb(0.05);
+        rrb.setNumThreads(num_threads);
+        double seconds = runFrames(rrb, frames, origins);
+
+        std::cout << "threads: " << num_threads
+                  << " time [s]: " << seconds
+                  << " speedup: " << std::setprecision(2) << serial_seconds / seconds
+                  << std::setprecision(4)
+                  << " identical: " << (sameMap(reference, rrb) ? "yes" : "no") << std::endl;
+    }
+
+    // Query points inside the volume
+    std::vector<Eigen::Vector3f> queries(1000000);
+    for (Eigen::Vector3f & q : queries) {
+        q = Eigen::Vector3f::Random() * 1.5f;
+    }
+
+    // Parallel distance transform
+    std::vector<Eigen::Vector3f> edt_queries(queries.begin(), queries.begin() + 100000);
+    std::vector<float> edt_distances_6, edt_distances_7;
+    benchmarkEdtThreads<6>(max_threads, false, false, frames, origins, edt_queries, edt_distances_6);
+    benchmarkEdtThreads<6>(max_threads, true, false, frames, origins, edt_queries, edt_distances_6);
+    benchmarkEdtThreads<7>(max_threads, false, false, frames, origins, edt_queries, edt_distances_7);
+    benchmarkEdtThreads<7>(max_threads, true, false, frames, origins, edt_queries, edt_distances_7);
+
+    // Signed distance transform
+    std::vector<float> signed_distances_6;
+    benchmarkEdtThreads<6>(max_threads, false, true, frames, origins, edt_queries, signed_distances_6);
+    benchmarkEdtThreads<6>(max_threads, true, true, frames, origins, edt_queries, signed_distances_6);
+
+    // Incremental distance transform
+    for (int move_every : {0, 5, 1}) {
+        std::vector<float> batch_distances, incremental_distances;
+
+        benchmarkIncremental(false, move_every, frames, origins, edt_queries, batch_distances);
+        std::cout << std::endl;
+
+        benchmarkIncremental(true, move_every, frames, origins, edt_queries, incremental_distances);
+
+        float max_error = 0;
+        for (size_t i = 0; i < edt_queries.size(); i++) {
+            max_error = std::max(max_error, std::abs(incremental_distances[i] - batch_distances[i]));
+        }
+        std::cout << " max difference [m]: " << max_error << std::endl;
+    }
+
+    // Lazy distance transform
+    std::vector<float> eager_distances, lazy_distances;
+
+    benchmarkLazy<6>(false, frames, origins, eager_distances);
+    std::cout << std::endl;
+    benchmarkLazy<6>(true, frames, origins, lazy_distances);
+    std::cout << " max difference [m]: " << maxDifference(lazy_distances, eager_distances) << std::endl;
+
+    benchmarkLazy<7>(false, frames, origins, eager_distances);
+    std::cout << std::endl;
+    benchmarkLazy<7>(true, frames, origins, lazy_distances);
+    std::cout << " max difference [m]: " << maxDifference(lazy_distances, eager_distances) << std::endl;
+
+    // Stored gradient field
+    std::vector<float> interpolated_distances, field_distances;
+
+    benchmarkGradientField<6>(false, frames, origins, queries, interpolated_distances);
+    std::cout << std::endl;
+    benchmarkGradientField<6>(true, frames, origins, queries, field_distances);
+    std::cout << " max difference [m]: " << maxDifference(field_distances, interpolated_distances) << std::endl;
+
+    benchmarkGradientField<7>(false, frames, origins, queries, interpolated_distances);
+    std::cout << std::endl;
+    benchmarkGradientField<7>(true, frames, origins, queries, field_distances);
+    std::cout << " max difference [m]: " << maxDifference(field_distances, interpolated_distances) << std::endl;
+
+    // Batched distance queries
+    for (int batch_size : {16, 64, 256}) {
+        benchmarkBatchQueries<6>(batch_size, frames, origins, queries);
+    }
+
+    // Distance storage, the double results are the reference
+    std::vector<float> reference_distances_6, reference_distances_7;
+
+    benchmarkDistanceStorage<6, double>("double", frames, origins, queries, reference_distances_6);
+    benchmarkDistanceStorage<6, float>("float", frames, origins, queries, reference_distances_6);
+    benchmarkDistanceStorage<6, uint16_t>("uint16", frames, origins, queries, reference_distances_6);
+    benchmarkDistanceStorage<6, uint8_t>("uint8", frames, origins, queries, reference_distances_6);
+
+    benchmarkDistanceStorage<7, double>("double", frames, origins, queries, reference_distances_7);
+    benchmarkDistanceStorage<7, float>("float", frames, origins, queries, reference_distances_7);
+    benchmarkDistanceStorage<7, uint16_t>("uint16", frames, origins, queries, reference_distances_7);
+    benchmarkDistanceStorage<7, uint8_t>("uint8", frames, origins, queries, reference_distances_7);
+
+    // Occupancy and flag storage
+    int separate_occupied, interleaved_occupied;
+
+    benchmarkStorage<false>("separate", frames, origins, separate_occupied);
+    std::cout << std::endl;
+
+    benchmarkStorage<true>("interleaved", frames, origins, interleaved_occupied);
+    std::cout << " identical: " << (separate_occupied == interleaved_occupied ? "yes" : "no") << std::endl;
+
+    // Memory layouts
+    std::vector<float> linear_distances, distances;
+
+    benchmarkLayout<ewok::LinearLayout>("linear", frames, origins, queries, linear_distances);
+    std::cout << std::endl;
+
+    benchmarkLayout<ewok::Bricked4Layout>("bricked4", frames, origins, queries, distances);
+    std::cout << " max difference [m]: " << maxDifference(distances, linear_distances) << std::endl;
+
+    benchmarkLayout<ewok::Bricked8Layout>("bricked8", frames, origins, queries, distances);
+    std::cout << " max difference [m]: " << maxDifference(distances, linear_distances) << std::endl;
+
+    benchmarkLayout<ewok::MortonLayout>("morton", frames, origins, queries, distances);
+    std::cout << " max difference [m]: " << maxDifference(distances, linear_distances) << std::endl;
+
+    return 0;
+}
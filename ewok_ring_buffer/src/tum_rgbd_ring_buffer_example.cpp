@@ -126,7 +126,6 @@ void processImage(const cv::Mat & img, const Eigen::Matrix4f & T_w_c)
 
     uint16_t * data = (uint16_t *) img.data;
 
-    ewok::EuclideanDistanceRingBuffer<POW>::PointCloud cloud1;
     octomap::Pointcloud octomap_cloud;
 
     const int subsample = 4;
@@ -148,7 +147,6 @@ void processImage(const cv::Mat & img, const Eigen::Matrix4f & T_w_c)
                 p = T_w_c * p;
 
                 //ROS_INFO_STREAM(p);
-                cloud1.push_back(p);
                 octomap_cloud.push_back(p(0), p(1), p(2));
             }
         }
@@ -186,7 +184,8 @@ void processImage(const cv::Mat & img, const Eigen::Matrix4f & T_w_c)
 
     auto t1 = std::chrono::high_resolution_clock::now();
 
-    rrb.insertPointCloud(cloud1, origin);
+    rrb.insertDepthImage(data, img.cols, img.rows, Eigen::Vector4f(fx, fy, cx, cy),
+                         T_w_c, subsample, 1/5000.0f);
 
     auto t2 = std::chrono::high_resolution_clock::now();
 
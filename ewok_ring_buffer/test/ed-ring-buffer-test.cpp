@@ -0,0 +1,889 @@
+/**
+* This file is part of Ewok.
+*
+* Copyright 2017 Vladyslav Usenko, Technical University of Munich.
+* Developed by Vladyslav Usenko <vlad dot usenko at tum dot de>,
+* for more information see <http://vision.in.tum.de/research/robotvision/replanning>.
+* If you use this code, please cite the respective publications as
+* listed on the above website.
+*
+* Ewok is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* Ewok is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with Ewok. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ewok/ed_ring_buffer.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+
+template<int _POW, typename _Datatype, typename _Scalar>
+struct TypeDefinitions {
+  static const int POW = _POW;
+  typedef _Datatype Datatype;
+  typedef _Scalar Scalar;
+};
+
+typedef ::testing::Types <
+                          TypeDefinitions<6, int16_t, float>,
+                          TypeDefinitions<5, int16_t, double>
+                          > Implementations;
+
+
+
+template <class T>
+class EuclideanDistanceRingBufferTest : public testing::Test {
+};
+
+
+TYPED_TEST_CASE(EuclideanDistanceRingBufferTest, Implementations);
+
+// Inserts random clouds around the volume center into all buffers and
+// moves them by direction afterwards.
+template<typename EDRB>
+void insertRandomCloud(std::vector<EDRB *> & edrbs, int num_points,
+                       const typename EDRB::Vector3i & direction)
+{
+  typedef typename EDRB::Vector3 Vector3;
+  typedef typename EDRB::Vector4 Vector4;
+
+  Vector3 origin;
+  edrbs[0]->getPoint(edrbs[0]->getVolumeCenter(), origin);
+
+  const typename Vector3::Scalar extent = edrbs[0]->getResolution() * EDRB::_N * 0.6;
+
+  typename EDRB::PointCloud cloud;
+  for(int i=0; i<num_points; i++) {
+    Vector4 p;
+    p.template head<3>() = origin + Vector3::Random() * extent;
+    p[3] = 0;
+    cloud.push_back(p);
+  }
+
+  for(EDRB * edrb : edrbs) {
+    edrb->insertPointCloud(cloud, origin);
+    edrb->updateDistance();
+    edrb->moveVolume(direction);
+  }
+}
+
+// Tests that the vectorized integer distance transform gives the same
+// distances and gradients as the default transform. The small truncation
+// distance uses the window scan, the large one the lower envelope.
+//
+TYPED_TEST(EuclideanDistanceRingBufferTest, TestVectorizedEdt)
+{
+  typedef ewok::EuclideanDistanceRingBuffer<TypeParam::POW,
+      typename TypeParam::Datatype, typename TypeParam::Scalar>
+      EuclideanDistanceRingBufferType;
+
+  typedef typename EuclideanDistanceRingBufferType::Vector3 Vector3;
+  typedef typename EuclideanDistanceRingBufferType::Vector3i Vector3i;
+
+  const int N = EuclideanDistanceRingBufferType::_N;
+  const typename TypeParam::Scalar res = 0.1;
+
+  for(typename TypeParam::Scalar truncation : {0.8, 4.0}) {
+    EuclideanDistanceRingBufferType scalar(res, truncation), vectorized(res, truncation);
+    vectorized.setVectorizedEdt(true);
+
+    std::vector<EuclideanDistanceRingBufferType *> edrbs = {&scalar, &vectorized};
+
+    for(int iter=0; iter<6; iter++) {
+      // Large clouds change the whole volume, small ones only a part of it
+      insertRandomCloud(edrbs, iter % 2 ? 20 : 500, Vector3i(iter % 3, 0, -(iter % 2)));
+      insertRandomCloud(edrbs, 5, Vector3i(0, 0, 0));
+
+      Vector3i offset = scalar.getVolumeCenter() - Vector3i(N/2, N/2, N/2);
+      for(int x=0; x<N; x++) {
+        for(int y=0; y<N; y++) {
+          for(int z=0; z<N; z++) {
+            Vector3 point, s_grad, v_grad;
+            scalar.getPoint(offset + Vector3i(x, y, z), point);
+
+            // The gradient is not set at the border of the volume
+            s_grad.setZero();
+            v_grad.setZero();
+
+            ASSERT_EQ(scalar.getDistanceWithGrad(point, s_grad), vectorized.getDistanceWithGrad(point, v_grad))
+                << "iter: " << iter << " voxel: " << x << " " << y << " " << z;
+            ASSERT_EQ(s_grad, v_grad);
+          }
+        }
+      }
+    }
+  }
+}
+
+// Tests that the incremental distance transform stays close to the batch
+// transform over insertions, which also free voxels, and volume moves.
+//
+TYPED_TEST(EuclideanDistanceRingBufferTest, TestIncrementalEdt)
+{
+  typedef ewok::EuclideanDistanceRingBuffer<TypeParam::POW,
+      typename TypeParam::Datatype, typename TypeParam::Scalar>
+      EuclideanDistanceRingBufferType;
+
+  typedef typename TypeParam::Scalar Scalar;
+  typedef typename EuclideanDistanceRingBufferType::Vector3 Vector3;
+  typedef typename EuclideanDistanceRingBufferType::Vector3i Vector3i;
+
+  const int N = EuclideanDistanceRingBufferType::_N;
+  const Scalar res = 0.1;
+
+  EuclideanDistanceRingBufferType batch(res, 0.8), incremental(res, 0.8);
+
+  std::vector<EuclideanDistanceRingBufferType *> edrbs = {&batch, &incremental};
+
+  insertRandomCloud(edrbs, 300, Vector3i(0, 0, 0));
+
+  // Starts from an existing map
+  incremental.setIncrementalEdt(true);
+
+  for(int iter=0; iter<10; iter++) {
+    insertRandomCloud(edrbs, iter % 2 ? 30 : 300, Vector3i(0, 0, 0));
+    insertRandomCloud(edrbs, 10, Vector3i(iter % 3, -(iter % 2), 1 - 2 * (iter % 2)));
+
+    batch.updateDistance();
+    incremental.updateDistance();
+
+    Scalar max_error = 0;
+    int num_different = 0;
+
+    Vector3i offset = batch.getVolumeCenter() - Vector3i(N/2, N/2, N/2);
+    for(int x=0; x<N; x++) {
+      for(int y=0; y<N; y++) {
+        for(int z=0; z<N; z++) {
+          Vector3 point, b_grad, i_grad;
+          batch.getPoint(offset + Vector3i(x, y, z), point);
+
+          const Scalar error = incremental.getDistanceWithGrad(point, i_grad) - batch.getDistanceWithGrad(point, b_grad);
+
+          // Distances are never too small, so they are safe for planning
+          ASSERT_GE(error, -1e-5) << "iter: " << iter << " voxel: " << x << " " << y << " " << z;
+
+          max_error = std::max(max_error, error);
+          num_different += error > 1e-5;
+        }
+      }
+    }
+
+    EXPECT_LT(max_error, 0.5 * res) << "iter: " << iter;
+    EXPECT_LT(num_different, N*N*N / 1000) << "iter: " << iter;
+  }
+}
+
+// Tests that updating only the dirty bricks gives the exact truncated
+// distance, computed by brute force for random voxels, after small and
+// large insertions and moves along all axes.
+//
+TYPED_TEST(EuclideanDistanceRingBufferTest, TestDirtyBricks)
+{
+  typedef ewok::EuclideanDistanceRingBuffer<TypeParam::POW,
+      typename TypeParam::Datatype, typename TypeParam::Scalar>
+      EuclideanDistanceRingBufferType;
+
+  typedef typename TypeParam::Scalar Scalar;
+  typedef typename EuclideanDistanceRingBufferType::Vector3 Vector3;
+  typedef typename EuclideanDistanceRingBufferType::Vector3i Vector3i;
+
+  const int N = EuclideanDistanceRingBufferType::_N;
+  const Scalar res = 0.1;
+  const Scalar truncation = 0.8;
+  const int band = 8;
+
+  EuclideanDistanceRingBufferType edrb(res, truncation);
+  std::vector<EuclideanDistanceRingBufferType *> edrbs = {&edrb};
+
+  for(int iter=0; iter<12; iter++) {
+    insertRandomCloud(edrbs, iter % 4 ? 10 : 300, Vector3i(0, 0, 0));
+    insertRandomCloud(edrbs, 5, Vector3i(iter % 3 - 1, (iter % 5) - 2, iter % 2 ? 9 : 0));
+    edrb.updateDistance();
+
+    Vector3i offset = edrb.getVolumeCenter() - Vector3i(N/2, N/2, N/2);
+
+    for(int i=0; i<1000; i++) {
+      // The interpolation needs the next voxel along all axes
+      const Vector3i idx = offset + Vector3i(std::rand() % (N-1), std::rand() % (N-1), std::rand() % (N-1));
+
+      int min_dist2 = band * band + 1;
+      for(int x=-band; x<=band; x++) {
+        for(int y=-band; y<=band; y++) {
+          for(int z=-band; z<=band; z++) {
+            const Vector3i n = idx + Vector3i(x, y, z);
+            if (((n - offset).array() < 0).any() || ((n - offset).array() >= N).any()) continue;
+            if (edrb.isOccupied(n)) min_dist2 = std::min(min_dist2, x*x + y*y + z*z);
+          }
+        }
+      }
+
+      Vector3 point, grad;
+      edrb.getPoint(idx, point);
+
+      const Scalar expected = std::min(res * std::sqrt(Scalar(min_dist2)), truncation);
+      ASSERT_NEAR(expected, edrb.getDistanceWithGrad(point, grad), 1e-4)
+          << "iter: " << iter << " voxel: " << (idx - offset).transpose();
+    }
+  }
+}
+
+// Tests that the lazy transform gives the same distances as the eager one.
+// Only a few points are queried between most updates, so stale bricks
+// pile up over insertions and moves before the whole volume is compared.
+//
+TYPED_TEST(EuclideanDistanceRingBufferTest, TestLazyEdt)
+{
+  typedef ewok::EuclideanDistanceRingBuffer<TypeParam::POW,
+      typename TypeParam::Datatype, typename TypeParam::Scalar>
+      EuclideanDistanceRingBufferType;
+
+  typedef typename TypeParam::Scalar Scalar;
+  typedef typename EuclideanDistanceRingBufferType::Vector3 Vector3;
+  typedef typename EuclideanDistanceRingBufferType::Vector3i Vector3i;
+
+  const int N = EuclideanDistanceRingBufferType::_N;
+  const Scalar res = 0.1;
+
+  EuclideanDistanceRingBufferType eager(res, 0.8), lazy(res, 0.8);
+  lazy.setLazyEdt(true);
+
+  std::vector<EuclideanDistanceRingBufferType *> edrbs = {&eager, &lazy};
+
+  for(int iter=0; iter<8; iter++) {
+    insertRandomCloud(edrbs, iter % 2 ? 20 : 300, Vector3i(iter % 3, 0, -(iter % 2)));
+
+    // The eager buffer only fills the entered slab on the next update
+    eager.updateDistance();
+    lazy.updateDistance();
+
+    Vector3 center;
+    lazy.getPoint(lazy.getVolumeCenter(), center);
+
+    for(int i=0; i<20; i++) {
+      Vector3 point = center + Vector3::Random() * res * N * 0.5;
+      Vector3 e_grad, l_grad;
+      e_grad.setZero();
+      l_grad.setZero();
+
+      ASSERT_EQ(eager.getDistanceWithGrad(point, e_grad), lazy.getDistanceWithGrad(point, l_grad))
+          << "iter: " << iter << " point: " << point.transpose();
+      ASSERT_EQ(e_grad, l_grad);
+    }
+
+    if (iter % 3 != 2) continue;
+
+    Vector3i offset = eager.getVolumeCenter() - Vector3i(N/2, N/2, N/2);
+    for(int x=0; x<N; x++) {
+      for(int y=0; y<N; y++) {
+        for(int z=0; z<N; z++) {
+          Vector3 point, e_grad, l_grad;
+          eager.getPoint(offset + Vector3i(x, y, z), point);
+          e_grad.setZero();
+          l_grad.setZero();
+
+          ASSERT_EQ(eager.getDistanceWithGrad(point, e_grad), lazy.getDistanceWithGrad(point, l_grad))
+              << "iter: " << iter << " voxel: " << x << " " << y << " " << z;
+          ASSERT_EQ(e_grad, l_grad);
+        }
+      }
+    }
+  }
+}
+
+// Tests that the stored interpolation cells give the same distances and
+// gradients as the interpolation of the distance buffer, with the batch,
+// the lazy and the incremental transform.
+//
+TYPED_TEST(EuclideanDistanceRingBufferTest, TestGradientField)
+{
+  typedef ewok::EuclideanDistanceRingBuffer<TypeParam::POW,
+      typename TypeParam::Datatype, typename TypeParam::Scalar>
+      EuclideanDistanceRingBufferType;
+
+  typedef typename TypeParam::Scalar Scalar;
+  typedef typename EuclideanDistanceRingBufferType::Vector3 Vector3;
+  typedef typename EuclideanDistanceRingBufferType::Vector3i Vector3i;
+
+  const int N = EuclideanDistanceRingBufferType::_N;
+  const Scalar res = 0.1;
+
+  EuclideanDistanceRingBufferType batch(res, 0.8), batch_field(res, 0.8), lazy_field(res, 0.8);
+  EuclideanDistanceRingBufferType incremental(res, 0.8), incremental_field(res, 0.8);
+
+  batch_field.setGradientField(true);
+  lazy_field.setGradientField(true);
+  lazy_field.setLazyEdt(true);
+  incremental.setIncrementalEdt(true);
+  incremental_field.setIncrementalEdt(true);
+  incremental_field.setGradientField(true);
+
+  std::vector<EuclideanDistanceRingBufferType *> edrbs = {&batch, &batch_field, &lazy_field,
+                                                          &incremental, &incremental_field};
+
+  std::vector<std::pair<EuclideanDistanceRingBufferType *, EuclideanDistanceRingBufferType *>> pairs = {
+      {&batch, &batch_field}, {&batch, &lazy_field}, {&incremental, &incremental_field}};
+
+  for(int iter=0; iter<6; iter++) {
+    insertRandomCloud(edrbs, iter % 2 ? 20 : 300, Vector3i(iter % 3, 0, -(iter % 2)));
+
+    for(EuclideanDistanceRingBufferType * edrb : edrbs) edrb->updateDistance();
+
+    Vector3 center;
+    batch.getPoint(batch.getVolumeCenter(), center);
+
+    for(auto & pair : pairs) {
+      for(int i=0; i<20000; i++) {
+        Vector3 point = center + Vector3::Random() * res * N * 0.5;
+        Vector3 r_grad, f_grad;
+        r_grad.setZero();
+        f_grad.setZero();
+
+        ASSERT_NEAR(pair.first->getDistanceWithGrad(point, r_grad),
+                    pair.second->getDistanceWithGrad(point, f_grad), 1e-5)
+            << "iter: " << iter << " point: " << point.transpose();
+
+        for(int axis=0; axis<3; axis++) {
+          ASSERT_NEAR(r_grad[axis], f_grad[axis], 1e-4)
+              << "iter: " << iter << " point: " << point.transpose() << " axis: " << axis;
+        }
+      }
+    }
+  }
+}
+
+// Tests the signed distance inside and outside solid blocks against brute
+// force for random voxels, with both transforms and the lazy one, one by
+// one and batched.
+//
+TYPED_TEST(EuclideanDistanceRingBufferTest, TestSignedDistance)
+{
+  typedef ewok::EuclideanDistanceRingBuffer<TypeParam::POW,
+      typename TypeParam::Datatype, typename TypeParam::Scalar>
+      EuclideanDistanceRingBufferType;
+
+  typedef typename TypeParam::Scalar Scalar;
+  typedef typename EuclideanDistanceRingBufferType::Vector3 Vector3;
+  typedef typename EuclideanDistanceRingBufferType::Vector3i Vector3i;
+  typedef typename EuclideanDistanceRingBufferType::Vector4 Vector4;
+  typedef typename EuclideanDistanceRingBufferType::Matrix3X Matrix3X;
+  typedef typename EuclideanDistanceRingBufferType::VectorX VectorX;
+
+  const int N = EuclideanDistanceRingBufferType::_N;
+  const Scalar res = 0.1;
+  const Scalar truncation = 0.4;
+  const int band = 4;
+  const int num_points = 1000;
+
+  EuclideanDistanceRingBufferType scalar(res, truncation), vectorized(res, truncation), lazy(res, truncation);
+  scalar.setSignedDistance(true);
+  vectorized.setSignedDistance(true);
+  vectorized.setVectorizedEdt(true);
+  lazy.setSignedDistance(true);
+  lazy.setLazyEdt(true);
+
+  std::vector<EuclideanDistanceRingBufferType *> edrbs = {&scalar, &vectorized, &lazy};
+
+  for(int iter=0; iter<6; iter++) {
+    // A solid block, every voxel is a ray endpoint and hit twice
+    Vector3i block_min = scalar.getVolumeCenter() + Vector3i(std::rand() % (N/2), std::rand() % (N/2), std::rand() % (N/2))
+        - Vector3i(N/2, N/2, N/2);
+    Vector3i block_size(2 + std::rand() % 12, 2 + std::rand() % 12, 2 + std::rand() % 12);
+
+    typename EuclideanDistanceRingBufferType::PointCloud cloud;
+    for(int x=0; x<block_size[0]; x++) {
+      for(int y=0; y<block_size[1]; y++) {
+        for(int z=0; z<block_size[2]; z++) {
+          Vector3 point;
+          scalar.getPoint(block_min + Vector3i(x, y, z), point);
+
+          Vector4 p;
+          p.template head<3>() = point;
+          p[3] = 0;
+          cloud.push_back(p);
+        }
+      }
+    }
+
+    Vector3 origin;
+    scalar.getPoint(scalar.getVolumeCenter() + Vector3i(N/2 - 1, N/2 - 1, N/2 - 1), origin);
+
+    for(EuclideanDistanceRingBufferType * edrb : edrbs) {
+      edrb->insertPointCloud(cloud, origin);
+      edrb->insertPointCloud(cloud, origin);
+    }
+
+    insertRandomCloud(edrbs, 30, Vector3i(iter % 2, 0, -(iter % 3)));
+
+    for(EuclideanDistanceRingBufferType * edrb : edrbs) edrb->updateDistance();
+
+    Vector3i offset = scalar.getVolumeCenter() - Vector3i(N/2, N/2, N/2);
+
+    Matrix3X points(3, num_points);
+    VectorX expected(num_points);
+
+    for(int i=0; i<num_points; i++) {
+      // The interpolation needs the next voxel along all axes and may
+      // round to the previous one, blocks are more likely to be hit in
+      // the lower half
+      const Vector3i idx = offset + Vector3i(1, 1, 1)
+          + Vector3i(std::rand() % (N-2), std::rand() % (N-2), std::rand() % (N-2)) / (i % 2 + 1);
+      const bool occupied = scalar.isOccupied(idx);
+
+      int min_dist2 = band * band + 1;
+      for(int x=-band; x<=band; x++) {
+        for(int y=-band; y<=band; y++) {
+          for(int z=-band; z<=band; z++) {
+            const Vector3i n = idx + Vector3i(x, y, z);
+            if (((n - offset).array() < 0).any() || ((n - offset).array() >= N).any()) continue;
+            if (scalar.isOccupied(n) != occupied) min_dist2 = std::min(min_dist2, x*x + y*y + z*z);
+          }
+        }
+      }
+
+      expected[i] = (occupied ? -1 : 1) * std::min(res * std::sqrt(Scalar(min_dist2)), truncation);
+
+      Vector3 point;
+      scalar.getPoint(idx, point);
+      points.col(i) = point;
+
+      for(EuclideanDistanceRingBufferType * edrb : edrbs) {
+        Vector3 grad;
+        ASSERT_NEAR(expected[i], edrb->getDistanceWithGrad(point, grad), 1e-4)
+            << "iter: " << iter << " voxel: " << (idx - offset).transpose() << " occupied: " << occupied;
+      }
+    }
+
+    for(EuclideanDistanceRingBufferType * edrb : edrbs) {
+      VectorX distances;
+      Matrix3X grads;
+      edrb->getDistancesWithGrad(points, distances, grads);
+
+      for(int i=0; i<num_points; i++) {
+        ASSERT_NEAR(expected[i], distances[i], 1e-4) << "iter: " << iter << " point: " << i;
+      }
+    }
+  }
+}
+
+// Tests that quantized distances differ from the floating point ones by at
+// most half a step, for uint8 and uint16 storage.
+//
+TYPED_TEST(EuclideanDistanceRingBufferTest, TestQuantizedDistance)
+{
+  typedef typename TypeParam::Datatype Datatype;
+  typedef typename TypeParam::Scalar Scalar;
+
+  typedef ewok::EuclideanDistanceRingBuffer<TypeParam::POW, Datatype, Scalar> EuclideanDistanceRingBufferType;
+  typedef ewok::EuclideanDistanceRingBuffer<TypeParam::POW, Datatype, Scalar,
+      uint8_t, ewok::LinearLayout, false, uint8_t> Quantized8;
+  typedef ewok::EuclideanDistanceRingBuffer<TypeParam::POW, Datatype, Scalar,
+      uint8_t, ewok::LinearLayout, false, uint16_t> Quantized16;
+
+  typedef typename EuclideanDistanceRingBufferType::Vector3 Vector3;
+  typedef typename EuclideanDistanceRingBufferType::Vector3i Vector3i;
+  typedef typename EuclideanDistanceRingBufferType::Vector4 Vector4;
+
+  const int N = EuclideanDistanceRingBufferType::_N;
+  const Scalar res = 0.1;
+  const Scalar truncation = 0.8;
+
+  EuclideanDistanceRingBufferType edrb(res, truncation);
+  Quantized8 edrb8(res, truncation);
+  Quantized16 edrb16(res, truncation);
+
+  Vector3 origin;
+  edrb.getPoint(edrb.getVolumeCenter(), origin);
+
+  for(int iter=0; iter<4; iter++) {
+    typename EuclideanDistanceRingBufferType::PointCloud cloud;
+    for(int i=0; i<200; i++) {
+      Vector4 p;
+      p.template head<3>() = origin + Vector3::Random() * res * N * 0.6;
+      p[3] = 0;
+      cloud.push_back(p);
+    }
+
+    edrb.insertPointCloud(cloud, origin);
+    edrb8.insertPointCloud(cloud, origin);
+    edrb16.insertPointCloud(cloud, origin);
+
+    edrb.updateDistance();
+    edrb8.updateDistance();
+    edrb16.updateDistance();
+
+    Vector3i offset = edrb.getVolumeCenter() - Vector3i(N/2, N/2, N/2);
+    for(int x=0; x<N; x++) {
+      for(int y=0; y<N; y++) {
+        for(int z=0; z<N; z++) {
+          Vector3 point, grad;
+          edrb.getPoint(offset + Vector3i(x, y, z), point);
+
+          const Scalar d = edrb.getDistanceWithGrad(point, grad);
+
+          ASSERT_NEAR(d, edrb8.getDistanceWithGrad(point, grad), 0.5 * truncation / 255 + 1e-5);
+          ASSERT_NEAR(d, edrb16.getDistanceWithGrad(point, grad), 0.5 * truncation / 65535 + 1e-5);
+        }
+      }
+    }
+  }
+}
+
+// Tests that the tricubic interpolation gives the analytic gradient of its
+// distance, stays within a voxel of the trilinear one and computes the
+// same in the lazy mode.
+//
+TYPED_TEST(EuclideanDistanceRingBufferTest, TestTricubicInterpolation)
+{
+  typedef typename TypeParam::Datatype Datatype;
+  typedef typename TypeParam::Scalar Scalar;
+
+  typedef ewok::EuclideanDistanceRingBuffer<TypeParam::POW, Datatype, Scalar> EuclideanDistanceRingBufferType;
+
+  typedef typename EuclideanDistanceRingBufferType::Vector3 Vector3;
+  typedef typename EuclideanDistanceRingBufferType::Vector3i Vector3i;
+
+  const Scalar res = 0.1;
+  const Scalar truncation = 0.6;
+  const Scalar h = 1e-3;
+
+  EuclideanDistanceRingBufferType trilinear(res, truncation), tricubic(res, truncation, true),
+      lazy(res, truncation, true);
+  lazy.setLazyEdt(true);
+
+  std::vector<EuclideanDistanceRingBufferType *> edrbs = {&trilinear, &tricubic, &lazy};
+
+  for(int iter=0; iter<6; iter++) {
+    insertRandomCloud(edrbs, 100, Vector3i(iter % 2, -(iter % 3), 0));
+
+    for(EuclideanDistanceRingBufferType * edrb : edrbs) edrb->updateDistance();
+
+    Vector3 min_point, max_point;
+    trilinear.getVolumeMinMax(min_point, max_point);
+
+    for(int i=0; i<2000; i++) {
+      // Keep the stencil and the finite differences inside the volume
+      const Vector3 point = min_point.array() + 2*res
+          + (Vector3::Random().array() + 1) * 0.5 * ((max_point - min_point).array() - 4*res);
+
+      Vector3 grad, grad_trilinear, grad_lazy, grad_tmp;
+      const Scalar d = tricubic.getDistanceWithGrad(point, grad);
+
+      ASSERT_NEAR(d, lazy.getDistanceWithGrad(point, grad_lazy), 1e-5);
+      ASSERT_NEAR(0, (grad - grad_lazy).norm(), 1e-4);
+      ASSERT_NEAR(d, trilinear.getDistanceWithGrad(point, grad_trilinear), res);
+
+      for(int k=0; k<3; k++) {
+        const Vector3 step = Vector3::Unit(k) * h;
+        const Vector3 point_plus = point + step, point_minus = point - step;
+        const Scalar numeric = (tricubic.getDistanceWithGrad(point_plus, grad_tmp)
+            - tricubic.getDistanceWithGrad(point_minus, grad_tmp)) / (2*h);
+
+        ASSERT_NEAR(numeric, grad[k], 5e-3) << "iter: " << iter << " axis: " << k;
+      }
+    }
+  }
+}
+
+// Tests that batched queries give the distances and gradients of single
+// queries for every interpolation, including points outside the volume.
+//
+TYPED_TEST(EuclideanDistanceRingBufferTest, TestBatchQueries)
+{
+  typedef typename TypeParam::Datatype Datatype;
+  typedef typename TypeParam::Scalar Scalar;
+
+  typedef ewok::EuclideanDistanceRingBuffer<TypeParam::POW, Datatype, Scalar> EuclideanDistanceRingBufferType;
+
+  typedef typename EuclideanDistanceRingBufferType::Vector3 Vector3;
+  typedef typename EuclideanDistanceRingBufferType::Vector3i Vector3i;
+  typedef typename EuclideanDistanceRingBufferType::Matrix3X Matrix3X;
+  typedef typename EuclideanDistanceRingBufferType::VectorX VectorX;
+
+  const int N = EuclideanDistanceRingBufferType::_N;
+  const Scalar res = 0.1;
+  const Scalar truncation = 0.5;
+
+  EuclideanDistanceRingBufferType trilinear(res, truncation), lazy(res, truncation), field(res, truncation),
+      tricubic(res, truncation, true);
+  lazy.setLazyEdt(true);
+  field.setGradientField(true);
+
+  std::vector<EuclideanDistanceRingBufferType *> edrbs = {&trilinear, &lazy, &field, &tricubic};
+
+  for(int iter=0; iter<4; iter++) {
+    insertRandomCloud(edrbs, 100, Vector3i(iter % 2, 0, iter % 3));
+
+    for(EuclideanDistanceRingBufferType * edrb : edrbs) edrb->updateDistance();
+
+    Vector3 center;
+    trilinear.getPoint(trilinear.getVolumeCenter(), center);
+
+    // Some points leave the volume
+    Matrix3X points(3, 500);
+    for(int k=0; k<points.cols(); k++) {
+      points.col(k) = center + Vector3::Random() * res * N * 0.6;
+    }
+
+    for(EuclideanDistanceRingBufferType * edrb : edrbs) {
+      VectorX distances;
+      Matrix3X grads;
+      edrb->getDistancesWithGrad(points, distances, grads);
+
+      ASSERT_EQ(points.cols(), distances.size());
+      ASSERT_EQ(points.cols(), grads.cols());
+
+      for(int k=0; k<points.cols(); k++) {
+        Vector3 point = points.col(k), grad;
+        ASSERT_NEAR(edrb->getDistanceWithGrad(point, grad), distances[k], 1e-5);
+        ASSERT_NEAR(0, (grad - grads.col(k)).norm(), 1e-4);
+      }
+
+      VectorX unlocked_distances;
+      Matrix3X unlocked_grads;
+      {
+        std::unique_lock<std::mutex> lock = edrb->lockForQueries();
+        edrb->getDistancesWithGradUnlocked(points, unlocked_distances, unlocked_grads);
+
+        Vector3 point = points.col(0), grad;
+        ASSERT_EQ(distances[0], edrb->getDistanceWithGradUnlocked(point, grad));
+      }
+
+      ASSERT_EQ(distances, unlocked_distances);
+      ASSERT_EQ(grads, unlocked_grads);
+    }
+  }
+}
+
+// Tests that the segment check finds every collision of points sampled
+// densely along the segment, with and without the distance collision
+// check, and rarely reports more. The unlocked check gives the same result.
+//
+TYPED_TEST(EuclideanDistanceRingBufferTest, TestSegmentCheck)
+{
+  typedef typename TypeParam::Datatype Datatype;
+  typedef typename TypeParam::Scalar Scalar;
+
+  typedef ewok::EuclideanDistanceRingBuffer<TypeParam::POW, Datatype, Scalar> EuclideanDistanceRingBufferType;
+
+  typedef typename EuclideanDistanceRingBufferType::Vector3 Vector3;
+  typedef typename EuclideanDistanceRingBufferType::Vector3i Vector3i;
+
+  const int N = EuclideanDistanceRingBufferType::_N;
+  const Scalar res = 0.1;
+  const Scalar truncation = 0.8;
+  const Scalar radius = 0.3;
+
+  EuclideanDistanceRingBufferType occupancy_check(res, truncation), distance_check(res, truncation);
+  distance_check.setDistanceCollisionCheck(true);
+
+  std::vector<EuclideanDistanceRingBufferType *> edrbs = {&occupancy_check, &distance_check};
+
+  // Two hits make a voxel occupied
+  std::srand(7);
+  insertRandomCloud(edrbs, 150, Vector3i(0, 0, 0));
+  std::srand(7);
+  insertRandomCloud(edrbs, 150, Vector3i(0, 0, 0));
+
+  Vector3 center;
+  distance_check.getPoint(distance_check.getVolumeCenter(), center);
+
+  for(EuclideanDistanceRingBufferType * edrb : edrbs) {
+    int num_collisions = 0, num_extra = 0;
+
+    for(int i=0; i<500; i++) {
+      const Vector3 from = center + Vector3::Random() * res * N * 0.5;
+      const Vector3 to = from + Vector3::Random() * res * 20;
+
+      bool dense = false;
+      for(int k=0; k<=1000 && !dense; k++) {
+        dense = edrb->isNearObstacle(Vector3(from + (to - from) * (k / Scalar(1000))), radius);
+      }
+
+      const bool segment = edrb->isSegmentNearObstacle(from, to, radius);
+
+      ASSERT_TRUE(segment || !dense) << "from: " << from.transpose() << " to: " << to.transpose();
+
+      {
+        std::unique_lock<std::mutex> lock = edrb->lockForQueries();
+        ASSERT_EQ(segment, edrb->isSegmentNearObstacleUnlocked(from, to, radius, edrb->getObstacleStencil(radius)));
+      }
+
+      num_collisions += dense;
+      num_extra += segment && !dense;
+    }
+
+    EXPECT_GT(num_collisions, 50);
+    EXPECT_LE(num_extra, 5);
+  }
+}
+
+// Tests that the point check with the distance collision check gives the
+// same result as the occupancy check with the voxel stencil wherever the
+// stencil is a full ball, radius + resolution <= 0.3 at most here. For
+// larger radii the stencil is cut off in height, so the distance check
+// can only report more collisions.
+//
+TYPED_TEST(EuclideanDistanceRingBufferTest, TestDistanceCollisionCheck)
+{
+  typedef typename TypeParam::Datatype Datatype;
+  typedef typename TypeParam::Scalar Scalar;
+
+  typedef ewok::EuclideanDistanceRingBuffer<TypeParam::POW, Datatype, Scalar> EuclideanDistanceRingBufferType;
+
+  typedef typename EuclideanDistanceRingBufferType::Vector3 Vector3;
+  typedef typename EuclideanDistanceRingBufferType::Vector3i Vector3i;
+
+  const int N = EuclideanDistanceRingBufferType::_N;
+  const Scalar res = 0.1;
+  const Scalar truncation = 0.8;
+
+  EuclideanDistanceRingBufferType occupancy_check(res, truncation), distance_check(res, truncation),
+      lazy_check(res, truncation);
+  distance_check.setDistanceCollisionCheck(true);
+  lazy_check.setDistanceCollisionCheck(true);
+  lazy_check.setLazyEdt(true);
+
+  std::vector<EuclideanDistanceRingBufferType *> edrbs = {&occupancy_check, &distance_check, &lazy_check};
+
+  // Two hits make a voxel occupied
+  std::srand(11);
+  insertRandomCloud(edrbs, 1000, Vector3i(0, 0, 0));
+  std::srand(11);
+  insertRandomCloud(edrbs, 1000, Vector3i(0, 0, 0));
+
+  Vector3 center;
+  distance_check.getPoint(distance_check.getVolumeCenter(), center);
+
+  // Squared radii + resolution in voxels away from integers
+  for(Scalar radius : {Scalar(0.05), Scalar(0.15), Scalar(0.35), Scalar(0.55)}) {
+    const bool ball = radius + res <= 0.3;
+    int num_near = 0;
+
+    for(int i=0; i<2000; i++) {
+      // Some points leave the volume
+      const Vector3 point = center + Vector3::Random() * res * N * 0.6;
+
+      const bool occupancy = occupancy_check.isNearObstacle(point, radius);
+      num_near += occupancy;
+
+      for(EuclideanDistanceRingBufferType * edrb : {&distance_check, &lazy_check}) {
+        const bool distance = edrb->isNearObstacle(point, radius);
+
+        if (ball) {
+          ASSERT_EQ(occupancy, distance) << "radius: " << radius << " point: " << point.transpose();
+        } else {
+          ASSERT_TRUE(distance || !occupancy) << "radius: " << radius << " point: " << point.transpose();
+        }
+
+        std::unique_lock<std::mutex> lock = edrb->lockForQueries();
+        ASSERT_EQ(distance, edrb->isNearObstacleUnlocked(point, radius, edrb->getObstacleStencil(radius)));
+      }
+    }
+
+    EXPECT_GT(num_near, 20) << "radius: " << radius;
+  }
+}
+
+// Tests that inserting and moving on one thread while another thread
+// queries, which updates the distances when needed, loses no changes, in
+// the eager and the lazy mode.
+//
+TYPED_TEST(EuclideanDistanceRingBufferTest, TestConcurrentQueries)
+{
+  typedef ewok::EuclideanDistanceRingBuffer<TypeParam::POW,
+      typename TypeParam::Datatype, typename TypeParam::Scalar>
+      EuclideanDistanceRingBufferType;
+
+  typedef typename TypeParam::Scalar Scalar;
+  typedef typename EuclideanDistanceRingBufferType::Vector3 Vector3;
+  typedef typename EuclideanDistanceRingBufferType::Vector3i Vector3i;
+
+  const int N = EuclideanDistanceRingBufferType::_N;
+  const Scalar res = 0.1;
+
+  EuclideanDistanceRingBufferType reference(res, 0.8);
+  reference.setDistanceCollisionCheck(true);
+
+  typedef typename EuclideanDistanceRingBufferType::Vector4 Vector4;
+
+  // Only the queries update the distances
+  auto insertCloud = [&](EuclideanDistanceRingBufferType & edrb, int iter) {
+    Vector3 origin;
+    edrb.getPoint(edrb.getVolumeCenter(), origin);
+
+    typename EuclideanDistanceRingBufferType::PointCloud cloud;
+    for(int i=0; i<500; i++) {
+      Vector4 p;
+      p.template head<3>() = origin + Vector3::Random() * res * N * 0.6;
+      p[3] = 0;
+      cloud.push_back(p);
+    }
+
+    edrb.insertPointCloud(cloud, origin);
+    edrb.moveVolume(Vector3i(iter % 2, 0, 0));
+  };
+
+  std::srand(7);
+  std::vector<unsigned int> seeds;
+  for(int iter=0; iter<40; iter++) seeds.push_back(std::rand());
+
+  for(int iter=0; iter<40; iter++) {
+    std::srand(seeds[iter]);
+    insertCloud(reference, iter);
+  }
+  reference.updateDistance();
+
+  for(bool lazy : {false, true}) {
+    EuclideanDistanceRingBufferType concurrent(res, 0.8);
+    concurrent.setDistanceCollisionCheck(true);
+    concurrent.setLazyEdt(lazy);
+
+    // Queries at a fixed point, the volume center changes with the moves
+    Vector3 point;
+    concurrent.getPoint(concurrent.getVolumeCenter(), point);
+
+    std::atomic<bool> done(false);
+    std::thread writer([&] {
+      for(int iter=0; iter<40; iter++) {
+        std::srand(seeds[iter]);
+        insertCloud(concurrent, iter);
+      }
+      done = true;
+    });
+
+    while (!done) {
+      concurrent.isNearObstacle(point, 0.3);
+      concurrent.isSegmentNearObstacle(point, point + Vector3(1, 0.5, 0.2), 0.3);
+    }
+
+    writer.join();
+    concurrent.updateDistance();
+
+    Vector3i offset = reference.getVolumeCenter() - Vector3i(N/2, N/2, N/2);
+    for(int x=0; x<N; x++) {
+      for(int y=0; y<N; y++) {
+        for(int z=0; z<N; z++) {
+          Vector3 point, r_grad, c_grad;
+          reference.getPoint(offset + Vector3i(x, y, z), point);
+          ASSERT_NEAR(reference.getDistanceWithGrad(point, r_grad), concurrent.getDistanceWithGrad(point, c_grad), 1e-5)
+              << "lazy: " << lazy << " voxel: " << x << " " << y << " " << z;
+        }
+      }
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,317 @@
+/**
+* This file is part of Ewok.
+*
+* Copyright 2017 Vladyslav Usenko, Technical University of Munich.
+* Developed by Vladyslav Usenko <vlad dot usenko at tum dot de>,
+* for more information see <http://vision.in.tum.de/research/robotvision/replanning>.
+* If you use this code, please cite the respective publications as
+* listed on the above website.
+*
+* Ewok is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* Ewok is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with Ewok. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ewok/raycast_ring_buffer.h>
+#include <gtest/gtest.h>
+
+template<int _POW, typename _Datatype, typename _Scalar>
+struct TypeDefinitions {
+  static const int POW = _POW;
+  typedef _Datatype Datatype;
+  typedef _Scalar Scalar;
+};
+
+typedef ::testing::Types <
+                          TypeDefinitions<6, int16_t, float>,
+                          TypeDefinitions<5, int16_t, double>
+                          > Implementations;
+
+
+
+template <class T>
+class RaycastRingBufferTest : public testing::Test {
+};
+
+
+TYPED_TEST_CASE(RaycastRingBufferTest, Implementations);
+
+// Tests that the incrementally maintained voxel counters match a scan
+// of the full volume after insertions and volume moves.
+//
+TYPED_TEST(RaycastRingBufferTest, TestVoxelCounters)
+{
+  typedef ewok::RaycastRingBuffer<TypeParam::POW,
+      typename TypeParam::Datatype, typename TypeParam::Scalar>
+      RaycastRingBufferType;
+
+  typedef typename RaycastRingBufferType::Vector3 Vector3;
+  typedef typename RaycastRingBufferType::Vector3i Vector3i;
+  typedef typename RaycastRingBufferType::Vector4 Vector4;
+  typedef typename RaycastRingBufferType::PointCloud PointCloud;
+
+  const int N = RaycastRingBufferType::_N;
+  const typename TypeParam::Scalar res = 0.1;
+
+  RaycastRingBufferType rrb(res);
+
+  for(int iter=0; iter<20; iter++) {
+    Vector3i center = rrb.getVolumeCenter();
+    Vector3 origin;
+    rrb.getPoint(center, origin);
+
+    PointCloud cloud;
+    for(int i=0; i<300; i++) {
+      Vector4 p;
+      p.template head<3>() = origin + Vector3::Random() * res * N * 0.7;
+      p[3] = 0;
+      cloud.push_back(p);
+    }
+
+    for(int i=0; i<3; i++) {
+      rrb.insertPointCloud(cloud, origin);
+    }
+
+    int occupied = 0, free = 0;
+    Vector3i offset = center - Vector3i(N/2, N/2, N/2);
+    for(int x=0; x<N; x++) {
+      for(int y=0; y<N; y++) {
+        for(int z=0; z<N; z++) {
+          Vector3i idx = offset + Vector3i(x, y, z);
+          occupied += rrb.isOccupied(idx);
+          free += rrb.isFree(idx);
+        }
+      }
+    }
+
+    int c_occupied, c_free, c_unknown;
+    rrb.getVoxelCounts(c_occupied, c_free, c_unknown);
+
+    ASSERT_GT(c_occupied, 0);
+    ASSERT_EQ(occupied, c_occupied) << "iter: " << iter;
+    ASSERT_EQ(free, c_free) << "iter: " << iter;
+    ASSERT_EQ(N*N*N - occupied - free, c_unknown) << "iter: " << iter;
+
+    Vector3i direction((iter % 3) - 1, (iter % 2) ? 3 : -1, 3 * ((iter % 5) - 2));
+    if(iter == 10) direction[0] = N;
+    rrb.moveVolume(direction);
+  }
+}
+
+// Tests that parallel ray casting produces exactly the same map as the
+// serial insertion.
+//
+TYPED_TEST(RaycastRingBufferTest, TestParallelInsertion)
+{
+  typedef ewok::RaycastRingBuffer<TypeParam::POW,
+      typename TypeParam::Datatype, typename TypeParam::Scalar>
+      RaycastRingBufferType;
+
+  typedef typename RaycastRingBufferType::Vector3 Vector3;
+  typedef typename RaycastRingBufferType::Vector3i Vector3i;
+  typedef typename RaycastRingBufferType::Vector4 Vector4;
+  typedef typename RaycastRingBufferType::PointCloud PointCloud;
+
+  const int N = RaycastRingBufferType::_N;
+  const typename TypeParam::Scalar res = 0.1;
+
+  RaycastRingBufferType serial(res), parallel(res);
+  parallel.setNumThreads(4);
+
+  for(int iter=0; iter<10; iter++) {
+    Vector3i center = serial.getVolumeCenter();
+    Vector3 origin;
+    serial.getPoint(center, origin);
+
+    // Some frames with zero or one point, which run on a single thread
+    const int num_points = iter % 3 == 2 ? iter % 2 : 1000;
+
+    PointCloud cloud;
+    for(int i=0; i<num_points; i++) {
+      Vector4 p;
+      p.template head<3>() = origin + Vector3::Random() * res * N;
+      p[3] = 0;
+      cloud.push_back(p);
+    }
+
+    serial.insertPointCloud(cloud, origin);
+    parallel.insertPointCloud(cloud, origin);
+
+    Vector3i s_min, s_max, p_min, p_max;
+    serial.getUpdatedMinMax(s_min, s_max);
+    parallel.getUpdatedMinMax(p_min, p_max);
+    ASSERT_EQ(s_min, p_min);
+    ASSERT_EQ(s_max, p_max);
+
+    Vector3i offset = center - Vector3i(N/2, N/2, N/2);
+    for(int x=0; x<N; x++) {
+      for(int y=0; y<N; y++) {
+        for(int z=0; z<N; z++) {
+          Vector3i idx = offset + Vector3i(x, y, z);
+          ASSERT_EQ(serial.isOccupied(idx), parallel.isOccupied(idx));
+          ASSERT_EQ(serial.isFree(idx), parallel.isFree(idx));
+          ASSERT_EQ(serial.isUpdated(idx), parallel.isUpdated(idx));
+        }
+      }
+    }
+
+    Vector3i direction(1, iter % 2, 0);
+    serial.moveVolume(direction);
+    parallel.moveVolume(direction);
+  }
+}
+
+
+// Tests that inserting a depth image gives the same map as inserting
+// the deprojected point cloud.
+//
+TYPED_TEST(RaycastRingBufferTest, TestInsertDepthImage)
+{
+  typedef ewok::RaycastRingBuffer<TypeParam::POW,
+      typename TypeParam::Datatype, typename TypeParam::Scalar>
+      RaycastRingBufferType;
+
+  typedef typename TypeParam::Scalar Scalar;
+  typedef typename RaycastRingBufferType::Vector3 Vector3;
+  typedef typename RaycastRingBufferType::Vector3i Vector3i;
+  typedef typename RaycastRingBufferType::Vector4 Vector4;
+  typedef typename RaycastRingBufferType::Matrix4 Matrix4;
+  typedef typename RaycastRingBufferType::PointCloud PointCloud;
+
+  const Scalar res = 0.1;
+
+  const int width = 64, height = 48, subsample = 2;
+  const Vector4 intrinsics(50, 50, 31.5, 23.5);
+
+  RaycastRingBufferType cloud_buffer(res), image_buffer(res);
+
+  for(int iter=0; iter<5; iter++) {
+    Vector3i center = cloud_buffer.getVolumeCenter();
+
+    Matrix4 T_w_c = Matrix4::Identity();
+    T_w_c.template topLeftCorner<3,3>() =
+        Eigen::AngleAxis<Scalar>(0.3 * iter, Vector3(0.2, 1, 0.1).normalized()).toRotationMatrix();
+    Vector3 origin;
+    cloud_buffer.getPoint(center, origin);
+    T_w_c.template topRightCorner<3,1>() = origin;
+
+    std::vector<float> depth(width * height);
+    for(float & d : depth) {
+      int r = std::rand() % 10;
+      d = r == 0 ? std::numeric_limits<float>::quiet_NaN() : (r == 1 ? 0 : 0.5 + 0.5 * r);
+    }
+
+    PointCloud cloud;
+    for(int v=0; v<height; v+=subsample) {
+      for(int u=0; u<width; u+=subsample) {
+        float d = depth[v * width + u];
+        if(!(d > 0) || !std::isfinite(d)) continue;
+
+        Vector4 p(d * (u - intrinsics[2]) / intrinsics[0], d * (v - intrinsics[3]) / intrinsics[1], d, 1);
+        cloud.push_back(T_w_c * p);
+      }
+    }
+
+    cloud_buffer.insertPointCloud(cloud, origin);
+    image_buffer.insertDepthImage(depth.data(), width, height, intrinsics, T_w_c, subsample);
+
+    int cloud_occupied, cloud_free, cloud_unknown;
+    int image_occupied, image_free, image_unknown;
+    cloud_buffer.getVoxelCounts(cloud_occupied, cloud_free, cloud_unknown);
+    image_buffer.getVoxelCounts(image_occupied, image_free, image_unknown);
+
+    // Both paths compute the same points with different rounding, so a few
+    // voxels on cell boundaries may differ.
+    EXPECT_NEAR(cloud_occupied, image_occupied, 2 + cloud_occupied / 50);
+    EXPECT_NEAR(cloud_free, image_free, 2 + cloud_free / 50);
+
+    Vector3i direction(1, 0, iter % 2);
+    cloud_buffer.moveVolume(direction);
+    image_buffer.moveVolume(direction);
+  }
+}
+
+// Tests that interleaved occupancy and flag storage gives exactly the same
+// map as separate buffers.
+//
+TYPED_TEST(RaycastRingBufferTest, TestInterleavedStorage)
+{
+  typedef ewok::RaycastRingBuffer<TypeParam::POW,
+      typename TypeParam::Datatype, typename TypeParam::Scalar>
+      RaycastRingBufferType;
+
+  typedef ewok::RaycastRingBuffer<TypeParam::POW,
+      typename TypeParam::Datatype, typename TypeParam::Scalar, uint8_t,
+      ewok::LinearLayout, true>
+      InterleavedRingBufferType;
+
+  typedef typename RaycastRingBufferType::Vector3 Vector3;
+  typedef typename RaycastRingBufferType::Vector3i Vector3i;
+  typedef typename RaycastRingBufferType::Vector4 Vector4;
+  typedef typename RaycastRingBufferType::PointCloud PointCloud;
+
+  const int N = RaycastRingBufferType::_N;
+  const typename TypeParam::Scalar res = 0.1;
+
+  RaycastRingBufferType separate(res);
+  InterleavedRingBufferType interleaved(res);
+
+  for(int iter=0; iter<10; iter++) {
+    Vector3i center = separate.getVolumeCenter();
+    ASSERT_EQ(center, interleaved.getVolumeCenter());
+
+    Vector3 origin;
+    separate.getPoint(center, origin);
+
+    PointCloud cloud;
+    for(int i=0; i<500; i++) {
+      Vector4 p;
+      p.template head<3>() = origin + Vector3::Random() * res * N * 0.8;
+      p[3] = 0;
+      cloud.push_back(p);
+    }
+
+    for(int i=0; i<2; i++) {
+      separate.insertPointCloud(cloud, origin);
+      interleaved.insertPointCloud(cloud, origin);
+    }
+
+    int s_occupied, s_free, s_unknown, i_occupied, i_free, i_unknown;
+    separate.getVoxelCounts(s_occupied, s_free, s_unknown);
+    interleaved.getVoxelCounts(i_occupied, i_free, i_unknown);
+    ASSERT_EQ(s_occupied, i_occupied);
+    ASSERT_EQ(s_free, i_free);
+
+    Vector3i offset = center - Vector3i(N/2, N/2, N/2);
+    for(int x=0; x<N; x++) {
+      for(int y=0; y<N; y++) {
+        for(int z=0; z<N; z++) {
+          Vector3i idx = offset + Vector3i(x, y, z);
+          ASSERT_EQ(separate.isOccupied(idx), interleaved.isOccupied(idx));
+          ASSERT_EQ(separate.isFree(idx), interleaved.isFree(idx));
+          ASSERT_EQ(separate.isUpdated(idx), interleaved.isUpdated(idx));
+        }
+      }
+    }
+
+    ASSERT_EQ(separate.isPointNear(origin, 0.5), interleaved.isPointNear(origin, 0.5));
+
+    Vector3i direction(2, -(iter % 3), iter % 2);
+    separate.moveVolume(direction);
+    interleaved.moveVolume(direction);
+  }
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
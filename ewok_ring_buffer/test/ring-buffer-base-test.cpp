@@ -90,6 +90,164 @@ TYPED_TEST(RingBudderBaseTest, TestPointIndexConversion)
 
 }
 
+// Tests the stencil based neighborhood query against a scan of the full volume.
+//
+TYPED_TEST(RingBudderBaseTest, TestIsPointNear)
+{
+  typedef ewok::RingBufferBase<TypeParam::POW,
+      typename TypeParam::Datatype, typename TypeParam::Scalar>
+      RingBufferBaseType;
+
+  typedef typename RingBufferBaseType::Vector3 Vector3;
+  typedef typename RingBufferBaseType::Vector3i Vector3i;
+  typedef typename TypeParam::Datatype Datatype;
+  typedef typename TypeParam::Scalar Scalar;
+
+  const int N = RingBufferBaseType::_N;
+  const Scalar res = 0.1;
+
+  RingBufferBaseType rbb(res);
+
+  for(int i=0; i<200; i++) {
+    Vector3i idx = (Vector3::Random() * N/2).template cast<int>();
+    rbb.at(idx) = 1;
+  }
+
+  auto is_set = [](const Datatype & d) { return d != 0; };
+
+  std::vector<Scalar> radii = {0.1, 0.25, 0.5, 0.7, 1.0};
+
+  for(auto rad: radii) {
+    const std::vector<Vector3i> & stencil = rbb.getNeighborhoodStencil(rad);
+
+    for(int i=0; i<500; i++) {
+      Vector3 point = Vector3::Random() * res * N/2;
+
+      Vector3i p_idx;
+      Vector3 p_point;
+      rbb.getIdx(point, p_idx);
+      rbb.getPoint(p_idx, p_point);
+
+      Scalar height_diff = std::max(rad/2, Scalar(0.3));
+
+      bool expected = false;
+      for(int x = -N/2; x < N/2 && !expected; x++) {
+        for(int y = -N/2; y < N/2 && !expected; y++) {
+          for(int z = -N/2; z < N/2 && !expected; z++) {
+            Vector3i coord(x, y, z);
+            Vector3 diff = (p_idx - coord).template cast<Scalar>() * res;
+
+            if(std::fabs(diff.z()) < height_diff && diff.dot(diff) < rad*rad && is_set(rbb.at(coord))) {
+              expected = true;
+            }
+          }
+        }
+      }
+
+      ASSERT_EQ(expected, rbb.isPointNear(point, rad, is_set)) << "rad: " << rad;
+      ASSERT_EQ(expected, rbb.isPointNear(point, stencil, is_set)) << "rad: " << rad;
+    }
+  }
+}
+
+
+// Checks that moving the volume keeps the voxels that stay inside and
+// resets the ones that enter.
+//
+template<typename TypeParam, template<int> class _Layout>
+void checkMoveVolume()
+{
+  typedef ewok::RingBufferBase<TypeParam::POW,
+      typename TypeParam::Datatype, typename TypeParam::Scalar, _Layout>
+      RingBufferBaseType;
+
+  typedef typename RingBufferBaseType::Vector3i Vector3i;
+  typedef typename TypeParam::Datatype Datatype;
+
+  const int N = RingBufferBaseType::_N;
+
+  RingBufferBaseType rbb(0.1, Datatype(0));
+
+  std::vector<Vector3i> shifts = {Vector3i(1, 0, 0), Vector3i(0, -1, 0), Vector3i(0, 0, 5),
+                                  Vector3i(-7, 3, 0), Vector3i(N-1, 0, -(N-1)), Vector3i(2, -N/2, 11),
+                                  Vector3i(0, N, 0), Vector3i(-3, -3, -3)};
+
+  for(const Vector3i & shift : shifts) {
+    Vector3i offset;
+    rbb.getOffset(offset);
+
+    // Encode the position in every voxel, 0 is the empty element
+    for(int x=0; x<N; x++) {
+      for(int y=0; y<N; y++) {
+        for(int z=0; z<N; z++) {
+          rbb.at(offset + Vector3i(x, y, z)) = 1 + x + 7 * y + 13 * z;
+        }
+      }
+    }
+
+    rbb.moveVolume(shift);
+
+    Vector3i new_offset;
+    rbb.getOffset(new_offset);
+    ASSERT_EQ(offset + shift, new_offset);
+
+    for(int x=0; x<N; x++) {
+      for(int y=0; y<N; y++) {
+        for(int z=0; z<N; z++) {
+          Vector3i old_local = Vector3i(x, y, z) + shift;
+
+          Datatype expected = 0;
+          if((old_local.array() >= 0).all() && (old_local.array() < N).all()) {
+            expected = 1 + old_local[0] + 7 * old_local[1] + 13 * old_local[2];
+          }
+
+          ASSERT_EQ(expected, rbb.at(new_offset + Vector3i(x, y, z)));
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(RingBudderBaseTest, TestMoveVolume)
+{
+  checkMoveVolume<TypeParam, ewok::LinearLayout>();
+  checkMoveVolume<TypeParam, ewok::Bricked4Layout>();
+  checkMoveVolume<TypeParam, ewok::Bricked8Layout>();
+  checkMoveVolume<TypeParam, ewok::MortonLayout>();
+}
+
+// Checks that a layout maps the voxels of the volume one to one
+// onto the storage.
+//
+template<int _POW, template<int> class _Layout>
+void checkLayoutIsPermutation()
+{
+  const int N = 1 << _POW;
+
+  std::vector<int> count(N*N*N, 0);
+
+  for(int x=0; x<N; x++) {
+    for(int y=0; y<N; y++) {
+      for(int z=0; z<N; z++) {
+        int i = _Layout<_POW>::index(x, y, z);
+        ASSERT_GE(i, 0);
+        ASSERT_LT(i, N*N*N);
+        count[i]++;
+      }
+    }
+  }
+
+  for(int c : count) ASSERT_EQ(1, c);
+}
+
+TYPED_TEST(RingBudderBaseTest, TestLayouts)
+{
+  checkLayoutIsPermutation<TypeParam::POW, ewok::LinearLayout>();
+  checkLayoutIsPermutation<TypeParam::POW, ewok::Bricked4Layout>();
+  checkLayoutIsPermutation<TypeParam::POW, ewok::Bricked8Layout>();
+  checkLayoutIsPermutation<TypeParam::POW, ewok::MortonLayout>();
+  checkLayoutIsPermutation<2, ewok::Bricked8Layout>();
+}
 
 int main(int argc, char **argv) {
   //srand((unsigned int) time(0));
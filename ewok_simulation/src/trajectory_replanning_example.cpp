@@ -102,36 +102,14 @@ void depthImageCallback(const sensor_msgs::Image::ConstPtr& msg)
     Eigen::Affine3d dT_w_c;
     tf::transformTFToEigen(transform, dT_w_c);
 
-    Eigen::Affine3f T_w_c = dT_w_c.cast<float>();
+    Eigen::Matrix4f T_w_c = dT_w_c.cast<float>().matrix();
 
-    float * data = (float *) cv_ptr->image.data;
+    const float * data = (const float *) cv_ptr->image.data;
 
 
     auto t1 = std::chrono::high_resolution_clock::now();
 
-    ewok::EuclideanDistanceRingBuffer<POW>::PointCloud cloud1;
-
-    for(int u=0; u < cv_ptr->image.cols; u+=4) {
-        for(int v=0; v < cv_ptr->image.rows; v+=4) {
-            float val = data[v*cv_ptr->image.cols + u];
-
-            //ROS_INFO_STREAM(val);
-
-            if(std::isfinite(val)) {
-                Eigen::Vector4f p;
-                p[0] = val*(u - cx)/fx;
-                p[1] = val*(v - cy)/fy;
-                p[2] = val;
-                p[3] = 1;
-
-                p = T_w_c * p;
-
-                cloud1.push_back(p);
-            }
-        }
-    }
-
-    Eigen::Vector3f origin = (T_w_c * Eigen::Vector4f(0,0,0,1)).head<3>();
+    Eigen::Vector3f origin = T_w_c.topRightCorner<3,1>();
 
     auto t2 = std::chrono::high_resolution_clock::now();
 
@@ -151,23 +129,18 @@ void depthImageCallback(const sensor_msgs::Image::ConstPtr& msg)
         offset = edrb->getVolumeCenter();
         diff = origin_idx - offset;
 
-        while(diff.array().any()) {
+        if(diff.array().any()) {
             //ROS_INFO("Moving Volume");
             edrb->moveVolume(diff);
-
-            offset = edrb->getVolumeCenter();
-            diff = origin_idx - offset;
         }
 
 
     }
 
-    //ROS_INFO_STREAM("cloud1 size: " << cloud1.size());
-
-
     auto t3 = std::chrono::high_resolution_clock::now();
 
-    edrb->insertPointCloud(cloud1, origin);
+    edrb->insertDepthImage(data, cv_ptr->image.cols, cv_ptr->image.rows,
+                           Eigen::Vector4f(fx, fy, cx, cy), T_w_c, 4);
 
     auto t4 = std::chrono::high_resolution_clock::now();
 
@@ -285,6 +258,10 @@ int main(int argc, char** argv){
     pnh.param("resolution", resolution, 0.15);
     edrb.reset(new ewok::EuclideanDistanceRingBuffer<POW>(resolution, 1.0));
 
+    int num_threads;
+    pnh.param("num_threads", num_threads, 1);
+    edrb->setNumThreads(num_threads);
+
     double distance_threshold;
     pnh.param("distance_threshold", distance_threshold, 0.5);
 
@@ -115,40 +115,9 @@ void depthImageCallback(const sensor_msgs::Image::ConstPtr& msg)
   Eigen::Affine3d dT_w_c;
   tf::transformTFToEigen(transform, dT_w_c);
 
-  Eigen::Affine3f T_w_c = dT_w_c.cast<float>();
+  const float* data = (const float*)cv_ptr->image.data;
 
-  float* data = (float*)cv_ptr->image.data;
-
-  auto t1 = std::chrono::high_resolution_clock::now();
-
-  ewok::EuclideanDistanceRingBuffer<POW, int16_t, double>::PointCloud cloud1;
-
-  for (int u = 0; u < cv_ptr->image.cols; u += 4)
-  {
-    for (int v = 0; v < cv_ptr->image.rows; v += 4)
-    {
-      double val = data[v * cv_ptr->image.cols + u];
-
-      // ROS_INFO_STREAM(val);
-
-      if (std::isfinite(val))
-      {
-        Eigen::Vector4d p;
-        p[0] = val * (u - cx) / fx;
-        p[1] = val * (v - cy) / fy;
-        p[2] = val;
-        p[3] = 1;
-
-        p = dT_w_c * p;
-
-        cloud1.push_back(p);
-      }
-    }
-  }
-
-  Eigen::Vector3d origin = (dT_w_c * Eigen::Vector4d(0, 0, 0, 1)).head<3>();
-
-  auto t2 = std::chrono::high_resolution_clock::now();
+  Eigen::Vector3d origin = dT_w_c.translation();
 
   if (!initialized)
   {
@@ -169,18 +138,16 @@ void depthImageCallback(const sensor_msgs::Image::ConstPtr& msg)
     offset = edrb->getVolumeCenter();
     diff = origin_idx - offset;
 
-    while (diff.array().any())
+    if (diff.array().any())
     {
       // ROS_INFO("Moving Volume");
       edrb->moveVolume(diff);
-
-      offset = edrb->getVolumeCenter();
-      diff = origin_idx - offset;
     }
   }
 
   mutex.lock();
-  edrb->insertPointCloud(cloud1, origin);
+  edrb->insertDepthImage(data, cv_ptr->image.cols, cv_ptr->image.rows,
+                         Eigen::Vector4d(fx, fy, cx, cy), dT_w_c.matrix(), 4);
   mutex.unlock();
   visualization_msgs::Marker m_occ, m_free;
   m_occ.lifetime = ros::Duration(0);
@@ -329,13 +296,14 @@ int main(int argc, char** argv)
   pnh.param("stop_yaw", stop_yaw, 0.0);
 
   double resolution, step_size, max_solve_t;
-  bool save_log, flat_height;
+  bool save_log, flat_height, distance_collision_check;
 
   pnh.param("step_size", step_size, 0.25);
   pnh.param("save_log", save_log, false);
   pnh.param("resolution", resolution, 0.15);
   pnh.param("flat_height", flat_height, true);
   pnh.param("max_solve_t", max_solve_t, 5.0);
+  pnh.param("distance_collision_check", distance_collision_check, false);
 
 
   pnh.param("dt", dt, 0.5);
@@ -369,6 +337,7 @@ int main(int argc, char** argv)
   }
 
   edrb.reset(new ewok::EuclideanDistanceRingBuffer<POW, int16_t, double>(resolution, 1.0));
+  edrb->setDistanceCollisionCheck(distance_collision_check);
 
   path_planner.reset(new ewok::RRTStar3D<POW, double>(step_size, 1.15, 0.6, max_solve_t, dt));
   path_planner->setDistanceBuffer(edrb);